@@ -49,7 +49,10 @@ def builder(output, inputs):
         return _decorated
     return _decorator
 
-RELEASE = False
+# Optimize the builds; turned off by `--debug`
+RELEASE = "--debug" not in sys.argv[1:]
+# Record trace events of AI searches in the game; see src/backend/trace.c
+TRACE = "--trace" in sys.argv[1:]
 BOARD_PATTERN = re.compile(r"BOARD_BEGIN\((\w+),")
 
 @builder("build/boards_glue.c", ["src/backend/boards_data.inc"])
@@ -63,6 +66,7 @@ def build_boards_glue() -> int:
         fp.write(
             '#include "../src/backend/lunar_game.h"\n'
             '#include <emscripten/emscripten.h>\n'
+            'void Glue_InitLoadedBoard(DisplayableBoard *board, int index);'
             'void EMSCRIPTEN_KEEPALIVE Glue_InitDisplayableBoard('
             'DisplayableBoard *board, int preset) {'
             'switch (preset) {'
@@ -72,7 +76,11 @@ def build_boards_glue() -> int:
                 f"case {id_}:"
                 f"INIT_DISPLAYABLE_PRESET_BOARD(board, {name}); break;"
             )
-        fp.write('}}')
+        # Boards loaded at run time come after the presets
+        fp.write(
+            f"default: Glue_InitLoadedBoard(board, preset - {len(name2id)});"
+            "}}"
+        )
     with open("src/frontend/boards.js", "w", encoding="utf-8") as fp:
         fp.write("export const Boards = {")
         for name, id_ in name2id.items():
@@ -109,30 +117,93 @@ EXPORTED_C_FUNCTIONS = [
     # not need to be included here.
     "malloc",
     "free",
-    "PatternNode_DeleteChain",
     "GameBoard_Delete",
-    "GameBoard_DestroyCard",
+    "GameBoard_View",
+    "GameLog_Delete",
+    "GameLog_Draw",
+    "GameLog_Deal",
+    "GameLog_Play",
+    "GameLog_AI",
+    "GameLog_Wildcard",
+    "GameLog_End",
+    "GameLog_ToText",
+    "GameBoard_SnapshotSize",
+    "GameBoard_Snapshot",
+    "AISearch_Step",
 ]
 
-@builder("src/frontend/backend.js", ALL_BACKEND_DEPENDENCIES)
-def build_backend() -> int:
+def _emcc_backend(output: str, flags: str) -> int:
+    """Compile the backend into ES6 module `output` with extra `flags`."""
     backend_files = " ".join(ALL_C_SOURCES)
-    flags = "-D NDEBUG -O3 -sASSERTIONS=0" if RELEASE else ""
     exports = ",".join("_" + x for x in EXPORTED_C_FUNCTIONS)
     return os.system(
         f"emcc -std=c99 -Wall {flags} {backend_files}"
-        " -D LUNAR_EMCC_TAKE_A_BREAK"
         f" -sEXPORTED_FUNCTIONS={exports} -sEXPORT_ES6"
-        " -sEXPORTED_RUNTIME_METHODS=getValue,setValue,cwrap"
-        ' -sENVIRONMENT=web "-sINCOMING_MODULE_JS_API=[]"'
-        " -sASYNCIFY"
-        " -o src/frontend/backend.js"
+        " -sEXPORTED_RUNTIME_METHODS=getValue,setValue,cwrap,HEAP8,HEAP32,"
+        "UTF8ToString,stringToUTF8,lengthBytesUTF8"
+        ' "-sINCOMING_MODULE_JS_API=[]"'
+        f" -o {output}"
     )
 
+# Profile of the native self-play workload, see `build_native_pgo`. It
+# is only written when the native compiler is Clang, in which case it
+# also works for emcc (as long as that Clang is not older than the
+# native one).
+CLANG_PROFILE = "build/native/lunar.profdata"
+_wasm_profile_inputs = [CLANG_PROFILE] if os.path.exists(CLANG_PROFILE) else []
+
+def _make_web_backend_builder(name: str, extra_flags: str):
+    output = f"src/frontend/{name}.js"
+    @builder(output, ALL_BACKEND_DEPENDENCIES + _wasm_profile_inputs)
+    def build_backend() -> int:
+        flags = "-D NDEBUG -O3 -sASSERTIONS=0" if RELEASE else ""
+        if TRACE:
+            flags += " -D LUNAR_TRACE"
+        if RELEASE and _wasm_profile_inputs:
+            flags += (
+                f" -fprofile-instr-use={CLANG_PROFILE}"
+                " -Wno-profile-instr-unprofiled"
+                " -Wno-profile-instr-out-of-date"
+            )
+        return _emcc_backend(
+            output,
+            f"{flags} {extra_flags} -sENVIRONMENT=web,worker"
+        )
+    return build_backend
+
+build_backend = _make_web_backend_builder("backend", "")
+# Loaded instead of the one above by browsers that support wasm SIMD
+build_backend_simd = _make_web_backend_builder("backend_simd", "-msimd128")
+
+# Backends for Node.js, used by `src/bench/bench.mjs` to measure the
+# AI outside the browser: (name, optimization flags)
+NODE_BACKEND_VARIANTS = [
+    ("O3", "-O3"),
+    ("O2", "-O2"),
+    ("Os", "-Os"),
+    ("O3-simd", "-O3 -msimd128"),
+]
+
+def _make_node_backend_builder(name: str, opt: str):
+    output = f"build/node/backend-{name}.mjs"
+    @builder(output, ALL_BACKEND_DEPENDENCIES)
+    def build_node_backend():
+        flags = f"-D NDEBUG {opt} -sASSERTIONS=0 -sENVIRONMENT=node"
+        return _emcc_backend(output, flags)
+    return build_node_backend
+
+node_backend_builders = tuple(
+    _make_node_backend_builder(*variant) for variant in NODE_BACKEND_VARIANTS
+)
+
 @builder("build/lunar.bundle.js", [
     "src/frontend/backend.js",
+    "src/frontend/backend_simd.js",
+    "src/frontend/backend_loader.js",
     "src/frontend/boards.js",
     "src/frontend/backend_consts.js",
+    "src/frontend/ai_pool.js",
+    "src/frontend/ai_cache.js",
     "src/frontend/frontend.js",
 ])
 def build_bundle() -> int:
@@ -144,6 +215,23 @@ def build_bundle() -> int:
         cwd="./src/frontend", shell=True
     ).returncode
 
+# The AI workers (see ai_pool.js) are module workers with their own copy
+# of the backend glue
+@builder("build/ai_worker.bundle.js", [
+    "src/frontend/backend.js",
+    "src/frontend/backend_simd.js",
+    "src/frontend/backend_loader.js",
+    "src/frontend/backend_consts.js",
+    "src/frontend/ai_worker.js",
+])
+def build_worker_bundle() -> int:
+    return subprocess.run(
+        ["npx", "rollup", "ai_worker.js", "-f", "es",
+         "-o", "../../build/ai_worker.bundle.js",
+         "-p", "@rollup/plugin-node-resolve"],
+        cwd="./src/frontend", shell=True
+    ).returncode
+
 def _make_minifier(in_file: str, out_file: str):
     """
     Make a builder that minifies `in_file` using `npx minify` and
@@ -166,11 +254,14 @@ def _make_minifier(in_file: str, out_file: str):
 
 minify_bundle = _make_minifier("build/lunar.bundle.js",
                                "dist/lunar.bundle.min.js")
+minify_worker_bundle = _make_minifier("build/ai_worker.bundle.js",
+                                      "dist/ai_worker.min.js")
 minify_html = _make_minifier("src/frontend/index.html", "dist/index.html")
 minify_css = _make_minifier("src/frontend/lunar.css", "dist/lunar.min.css")
 
 STATIC_FILES = [
     "backend.wasm",
+    "backend_simd.wasm",
     "favicon.ico",
     *glob.iglob("images/*", root_dir="src/frontend"),
 ]
@@ -191,9 +282,153 @@ def copy_all_static() -> int:
             return c
     return 0
 
+# Native build: a static library of the backend plus `lunar_cli` (and
+# `lunar_daemon` on POSIX systems), under build/native/<configuration>/.
+# `CC` and `AR` may be set in the environment to pick the tools.
+NATIVE_CC = os.environ.get("CC", "cc")
+NATIVE_BACKEND_SOURCES = sorted(glob.iglob("src/backend/*.c"))
+NATIVE_CLI_SOURCE = "src/native/lunar_cli.c"
+NATIVE_DAEMON_SOURCE = "src/native/lunar_daemon.c"
+NATIVE_DEPENDENCIES = [
+    *NATIVE_BACKEND_SOURCES,
+    NATIVE_CLI_SOURCE,
+    NATIVE_DAEMON_SOURCE,
+    "src/native/preset_boards.h",
+    "src/backend/lunar_game.h",
+    "src/backend/boards_data.inc",
+]
+NATIVE_RELEASE_FLAGS = "-O3 -D NDEBUG -flto"
+NATIVE_CONFIGS = {
+    "debug": "-O0 -g",
+    "release": NATIVE_RELEASE_FLAGS,
+    # For `lunar_cli selfplay --trace`
+    "trace": f"{NATIVE_RELEASE_FLAGS} -D LUNAR_TRACE",
+}
+# What `lunar_cli` runs to collect the profile for PGO
+PGO_WORKLOAD = ["selfplay", "--depth", "4"]
+
+def _native_compiler_is_clang() -> bool:
+    result = subprocess.run(
+        [NATIVE_CC, "--version"], capture_output=True, text=True
+    )
+    return "clang" in result.stdout
+
+def _native_archiver() -> str:
+    # LTO objects need an archiver that understands them
+    if "AR" in os.environ:
+        return os.environ["AR"]
+    if _native_compiler_is_clang():
+        return "llvm-ar" if shutil.which("llvm-ar") else "ar"
+    return "gcc-ar" if shutil.which("gcc-ar") else "ar"
+
+def _native_build(config: str, flags: str) -> int:
+    """
+    Compile the static library `liblunar.a`, `lunar_cli` and
+    `lunar_daemon` into build/native/`config`/ with `flags`.
+    """
+    out_dir = f"build/native/{config}"
+    os.makedirs(f"{out_dir}/obj", exist_ok=True)
+    cc = f"{NATIVE_CC} -std=c99 -Wall {flags}"
+    objects = []
+    for source in NATIVE_BACKEND_SOURCES:
+        obj = f"{out_dir}/obj/{os.path.basename(source)[:-2]}.o"
+        c = os.system(f"{cc} -c {source} -o {obj}")
+        if c:
+            return c
+        objects.append(obj)
+    library = f"{out_dir}/liblunar.a"
+    with contextlib.suppress(FileNotFoundError):
+        os.remove(library)
+    return (
+        os.system(f"{_native_archiver()} rcs {library} {' '.join(objects)}")
+        or os.system(
+            f"{cc} {NATIVE_CLI_SOURCE} {library} -lm"
+            f" -o {out_dir}/lunar_cli"
+        )
+        or (os.name == "posix" and os.system(
+            f"{cc} {NATIVE_DAEMON_SOURCE} {library} -lm -pthread"
+            f" -o {out_dir}/lunar_daemon"
+        ))
+    )
+
+def _make_native_builder(config: str, flags: str):
+    @builder(f"build/native/{config}/lunar_cli", NATIVE_DEPENDENCIES)
+    def build_native():
+        return _native_build(config, flags)
+    return build_native
+
+native_builders = tuple(
+    _make_native_builder(config, flags)
+    for config, flags in NATIVE_CONFIGS.items()
+)
+
+@builder("build/native/pgo/lunar_cli", NATIVE_DEPENDENCIES)
+def build_native_pgo() -> int:
+    """
+    Build an instrumented `lunar_cli`, run `PGO_WORKLOAD` with it and
+    build again using the profile. Both builds go to the same place so
+    that GCC finds its profiles by object file name.
+    """
+    profile_dir = os.path.abspath("build/native/pgo/profile")
+    shutil.rmtree(profile_dir, ignore_errors=True)
+    clang = _native_compiler_is_clang()
+    if clang:
+        gen_flags = "-fprofile-instr-generate"
+        use_flags = f"-fprofile-instr-use={CLANG_PROFILE}"
+    else:
+        gen_flags = f"-fprofile-generate={profile_dir}"
+        use_flags = (
+            f"-fprofile-use={profile_dir} -fprofile-partial-training"
+            " -Wno-missing-profile"
+        )
+    c = _native_build("pgo", f"{NATIVE_RELEASE_FLAGS} {gen_flags}")
+    if c:
+        return c
+    env = dict(os.environ, LLVM_PROFILE_FILE=f"{profile_dir}/%p.profraw")
+    c = subprocess.run(
+        ["build/native/pgo/lunar_cli", *PGO_WORKLOAD],
+        env=env, stdout=subprocess.DEVNULL
+    ).returncode
+    if c:
+        return c
+    if clang:
+        c = subprocess.run([
+            "llvm-profdata", "merge", "-output", CLANG_PROFILE,
+            *glob.iglob(f"{profile_dir}/*.profraw")
+        ]).returncode
+        if c:
+            return c
+    return _native_build("pgo", f"{NATIVE_RELEASE_FLAGS} {use_flags}")
+
+def build_all_native() -> int:
+    for builder in (*native_builders, build_native_pgo):
+        c = builder()
+        if c:
+            return c
+    return 0
+
+def build_all_node_backends() -> int:
+    with contextlib.suppress(FileExistsError):
+        os.mkdir("build/node")
+    for builder in node_backend_builders:
+        c = builder()
+        if c:
+            return c
+    return 0
+
 def main() -> int:
     with contextlib.suppress(FileExistsError):
         os.mkdir("build")
+    targets = [arg for arg in sys.argv[1:] if not arg.startswith("--")]
+    if targets == ["node"]:
+        # Only build the backends for benchmarking
+        return (
+            build_boards_glue()
+            or build_consts_glue()
+            or build_all_node_backends()
+        )
+    if targets == ["native"]:
+        return build_all_native()
     with contextlib.suppress(FileExistsError):
         os.mkdir("dist")
     with contextlib.suppress(FileExistsError):
@@ -202,8 +437,11 @@ def main() -> int:
         build_boards_glue()
         or build_consts_glue()
         or build_backend()
+        or build_backend_simd()
         or build_bundle()
         or minify_bundle()
+        or build_worker_bundle()
+        or minify_worker_bundle()
         or minify_html()
         or minify_css()
         or copy_all_static()
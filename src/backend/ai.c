@@ -1,4 +1,5 @@
 #include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include "lunar_game.h"
@@ -14,9 +15,14 @@ static void forkGameBoard(const GameBoard *board, GameBoard *to) {
     // `adj` does not change throughout the whole game so do a shallow
     // copy
     to->adj = board->adj;
+    to->owns_adj = false;
     to->black_stars = board->black_stars;
     to->white_stars = board->white_stars;
     to->perks = board->perks;
+    to->claimed[P_WHITE] = board->claimed[P_WHITE];
+    to->claimed[P_BLACK] = board->claimed[P_BLACK];
+    // Nobody reads the view of a fork
+    to->view = NULL;
     for (int i = 0; i < to->num_slots; ++i) {
         SlotData *data = &to->slots[i];
         SlotData_Deinit(data);
@@ -31,25 +37,23 @@ static void forkGameBoard(const GameBoard *board, GameBoard *to) {
     }
 }
 
-static float heuristic(const GameBoard *board) {
-    int res = board->black_stars - board->white_stars;
-    const int my_mult = (board->perks & PERK_SCORPIO) == 0;
-    const int opponent_mult = (board->perks & PERK_LIGHT_OF_VENUS) + 1;
-    for (int i = 0; i < board->num_slots; ++i) {
-        switch (board->slots[i].owner) {
-        case P_BLACK:
-            res += my_mult;
-            break;
-        case P_WHITE:
-            res -= opponent_mult;
-            break;
-        case P_NULL:  /* to avoid -Wswitch */
-            break;
-        }
-    }
+static float evaluate(
+    int black_stars, int white_stars, int perks, const int *claimed
+) {
+    int res = black_stars - white_stars;
+    const int my_mult = (perks & PERK_SCORPIO) == 0;
+    const int opponent_mult = (perks & PERK_LIGHT_OF_VENUS) + 1;
+    res += my_mult * claimed[P_BLACK];
+    res -= opponent_mult * claimed[P_WHITE];
     return (float) res;
 }
 
+static float heuristic(const GameBoard *board) {
+    return evaluate(
+        board->black_stars, board->white_stars, board->perks, board->claimed
+    );
+}
+
 typedef enum NodeKind {
     NK_MY_TURN,
     NK_OPPONENT_TURN,
@@ -74,54 +78,230 @@ static void printPrevDecisions(PrevDecision *p, int len) {
 }
 #endif
 
-typedef struct CacheHashMeta {
-    int len;
-    int total_states;
-} CacheHashMeta;
+void AIOptions_Init(AIOptions *options) {
+    options->cache_limit = AI_DEFAULT_CACHE_LIMIT;
+    options->abort_flag = NULL;
+    options->on_progress = NULL;
+    options->progress_userdata = NULL;
+    options->chance_samples = 0;
+    options->exact_chance_layers = 1;
+    options->sample_seed = 0;
+    options->root_split = 1;
+    options->root_part = 0;
+    options->shared_bound = NULL;
+}
+
+/*
+ * The search cache is a fixed-size table that maps `PrevDecision[]`
+ * keys to weights. It is allocated once per `AIMove` and never grows
+ * beyond `AIOptions.cache_limit` bytes; when it is full, old results
+ * are replaced instead.
+ *
+ * Each bucket has two entries. The first one is "depth-preferred": it
+ * keeps whichever result took the most nodes to compute. All cached
+ * results come from the same layer, so the size of the subtree that
+ * was searched is what tells a valuable entry from a cheap one. The
+ * second one is "always-replace": it takes every result that did not
+ * make it into the first entry, so recent results are kept as well.
+ *
+ * Instead of emptying the table for every first-layer move we bump
+ * `generation`; entries from older generations are treated as empty.
+ */
+
+typedef struct CacheEntry {
+    Hash hash;
+    float weight;
+    float variance;  /* Of `weight` as an estimate, see `SearchContext` */
+    unsigned generation;  /* 0 if never used */
+    long effort;  /* Number of nodes searched to compute `weight` */
+} CacheEntry;
+
+#define CACHE_BUCKET_SIZE 2
+
+typedef struct SearchCache {
+    CacheEntry *entries;
+    PrevDecision *keys;  /* `key_len` decisions for every entry */
+    int num_buckets;
+    int key_len;
+    int total_states;  /* Number of different `PrevDecision`s */
+    bool exact_hash;  /* Whether keys can be numbered without overflow */
+    unsigned generation;
+    size_t live_entries;  /* Entries filled in current generation */
+} SearchCache;
+
+static size_t cacheEntryBytes(int key_len) {
+    return sizeof(CacheEntry) + sizeof(PrevDecision) * key_len;
+}
+
+static SearchCache *newSearchCache(
+    size_t limit, int key_len, int total_states
+) {
+    /* Return NULL if `limit` can't even hold one bucket. */
+    const size_t bucket_bytes = CACHE_BUCKET_SIZE * cacheEntryBytes(key_len);
+    size_t num_buckets = limit / bucket_bytes;
+    // There can't be more distinct keys than this, so don't allocate
+    // more than that:
+    size_t max_keys = 1u;
+    for (int i = 0; i < key_len && max_keys < num_buckets; ++i) {
+        max_keys *= total_states;
+    }
+    if (num_buckets > max_keys) {
+        num_buckets = max_keys;
+    }
+    if (num_buckets > INT_MAX) {
+        num_buckets = INT_MAX;
+    }
+    if (num_buckets == 0) {
+        return NULL;
+    }
+    SearchCache *cache = (SearchCache *) malloc(sizeof(SearchCache));
+    const size_t num_entries = num_buckets * CACHE_BUCKET_SIZE;
+    cache->entries = (CacheEntry *) calloc(num_entries, sizeof(CacheEntry));
+    cache->keys = (PrevDecision *)
+        malloc(num_entries * key_len * sizeof(PrevDecision));
+    cache->num_buckets = (int) num_buckets;
+    cache->key_len = key_len;
+    cache->total_states = total_states;
+    // `cacheHash` stays below 2 * total_states ** key_len
+    Hash hash_bound = ULLONG_MAX / 2;
+    cache->exact_hash = true;
+    for (int i = 0; i < key_len && cache->exact_hash; ++i) {
+        hash_bound /= total_states;
+        cache->exact_hash = hash_bound > 0;
+    }
+    cache->generation = 0;
+    cache->live_entries = 0;
+    return cache;
+}
+
+static void deleteSearchCache(SearchCache *cache) {
+    free(cache->entries);
+    free(cache->keys);
+    free(cache);
+}
+
+static size_t cacheBytes(const SearchCache *cache) {
+    return (size_t) cache->num_buckets * CACHE_BUCKET_SIZE
+        * cacheEntryBytes(cache->key_len);
+}
+
+static void cacheNextGeneration(SearchCache *cache) {
+    ++cache->generation;
+    cache->live_entries = 0;
+}
 
-static Hash cacheHash(void *key, void *meta) {
+static Hash cacheHash(const SearchCache *cache, const PrevDecision *key) {
     Hash res = 1u;
-    CacheHashMeta *m = (CacheHashMeta *) meta;
-    PrevDecision *arr = (PrevDecision *) key;
-    for (int i = 0; i < m->len; ++i) {
-        res *= m->total_states;
-        res += arr[i].phase + arr[i].slot_id * MoonPhase_NumPhases;
+    for (int i = 0; i < cache->key_len; ++i) {
+        const Hash state =
+            key[i].phase + (Hash) key[i].slot_id * MoonPhase_NumPhases;
+        if (cache->exact_hash) {
+            // Every key gets its own number
+            res = res * cache->total_states + state;
+        }
+        else {
+            // Large boards or deep searches would overflow that
+            res = (res ^ state) * 0x9e3779b97f4a7c15ull;
+            res ^= res >> 29;
+        }
     }
     return res;
 }
 
-static bool cacheEq(void *key1, void *key2, void *meta) {
-    return !memcmp(
-        key1, key2, ((CacheHashMeta *) meta)->len * sizeof(PrevDecision)
-    );
+static CacheEntry *cacheBucket(const SearchCache *cache, Hash hash) {
+    return &cache->entries[hash % cache->num_buckets * CACHE_BUCKET_SIZE];
 }
 
-#ifdef LUNAR_EMCC_TAKE_A_BREAK
-// When building for Emscripten, return to JS event loop regularly when
-// running the AI as the AI takes a long time.
+static PrevDecision *cacheKeyOf(
+    const SearchCache *cache, const CacheEntry *entry
+) {
+    return &cache->keys[(entry - cache->entries) * cache->key_len];
+}
 
-#include <emscripten/emscripten.h>
+static const CacheEntry *cacheLookup(
+    const SearchCache *cache, const PrevDecision *key
+) {
+    /* Return NULL if not found. */
+    const Hash hash = cacheHash(cache, key);
+    const CacheEntry *bucket = cacheBucket(cache, hash);
+    for (int i = 0; i < CACHE_BUCKET_SIZE; ++i) {
+        const CacheEntry *entry = &bucket[i];
+        if (
+            entry->generation == cache->generation
+            && entry->hash == hash
+            && !memcmp(
+                cacheKeyOf(cache, entry), key,
+                cache->key_len * sizeof(PrevDecision)
+            )
+        ) {
+            return entry;
+        }
+    }
+    return NULL;
+}
 
-static int counter = 0;
+static void cacheFill(
+    SearchCache *cache, CacheEntry *entry, Hash hash,
+    const PrevDecision *key, float weight, float variance, long effort
+) {
+    if (entry->generation != cache->generation) {
+        ++cache->live_entries;
+    }
+    entry->hash = hash;
+    entry->weight = weight;
+    entry->variance = variance;
+    entry->generation = cache->generation;
+    entry->effort = effort;
+    memcpy(
+        cacheKeyOf(cache, entry), key, cache->key_len * sizeof(PrevDecision)
+    );
+}
 
-static void take_a_break(void) {
-    if (++counter >= 30) {
-        counter = 0;
-        emscripten_sleep(1);
+static void cacheStore(
+    SearchCache *cache, const PrevDecision *key, float weight,
+    float variance, long effort
+) {
+    /* `key` must not be in `cache` already. */
+    const Hash hash = cacheHash(cache, key);
+    CacheEntry *preferred = cacheBucket(cache, hash);
+    CacheEntry *always = preferred + 1;
+    if (
+        preferred->generation != cache->generation
+        || effort >= preferred->effort
+    ) {
+        if (preferred->generation == cache->generation) {
+            // Demote the old entry instead of throwing it away
+            if (always->generation != cache->generation) {
+                ++cache->live_entries;
+            }
+            *always = *preferred;
+            memcpy(
+                cacheKeyOf(cache, always), cacheKeyOf(cache, preferred),
+                cache->key_len * sizeof(PrevDecision)
+            );
+        }
+        cacheFill(cache, preferred, hash, key, weight, variance, effort);
+    }
+    else {
+        cacheFill(cache, always, hash, key, weight, variance, effort);
     }
 }
-#endif
 
-static float expectiminimax(
-    const GameBoard *board,
-    MoonPhase *cards,  /* We will restore after modifying it */
-    int num_cards,  /* Length of `cards` */
-    int played_card,  /* Index in `cards` */
-    float alpha,  /* For pruning */
-    int depth,
-    NodeKind node,
-    AIDecision *out_result,
-    // Following 3 parameters are for caching optimization
+// A node being searched. The search is a loop over a stack of these
+// rather than a recursive function, so that it can stop after any node
+// and go on later, see `AISearch_Step`.
+typedef struct SearchFrame {
+    NodeKind node;
+    const GameBoard *board;
+    // The children of NK_MY_TURN and NK_OPPONENT_TURN nodes are played
+    // on this. Its slots are kept for the next node at the same height
+    // of the stack.
+    GameBoard fork;
+    int played_card;  /* Index in `SearchContext.cards` */
+    float alpha;  /* For pruning */
+    int depth;  /* What the children have left */
+    AIDecision *out_result;
+    // Following 2 fields are for caching optimization
     // The core idea of this:
     // 1. The SCORE/WEIGHT outcome is the same if the computer performs
     //    the exact same set of `prev_decisions`, no matter what CARDS
@@ -133,198 +313,891 @@ static float expectiminimax(
     //    remain in the computer's hand in that layer, and conclude
     //    that: in that layer, as long as the `prev_decisions` is the
     //    same for two nodes, then the weight must be the same too.
-    // 4. We save some memory by allocating the hash map on the first
-    //    layer of NK_MY_TURN nodes. This is based on the fact that: if
-    //    X and Y are two first-layer NK_MY_TURN nodes, then any
-    //    ancestor of X don't have the same `prev_decisions` with any
-    //    ancestor of Y, because the decisions made at X and Y are 100%
-    //    different.
-    HashMap *cache,  /* PrevDecision[] -> float */
-    PrevDecision *prev_decisions,
-    int pd_ptr  /* Index in `prev_decisions` */
+    // 4. We only keep the cache valid within one first-layer NK_MY_TURN
+    //    node. This is based on the fact that: if X and Y are two
+    //    first-layer NK_MY_TURN nodes, then any ancestor of X don't
+    //    have the same `prev_decisions` with any ancestor of Y, because
+    //    the decisions made at X and Y are 100% different. That's why
+    //    `ctx->cache` starts a new generation for every one of them.
+    PrevDecision *prev_decisions;  /* NULL in the first layer */
+    int pd_ptr;  /* Index in `prev_decisions` */
+    float res;
+    float res_variance;
+    // The child being searched: card `k` on slot `i` (NK_MY_TURN),
+    // phase `j` on slot `i` (NK_OPPONENT_TURN) or draw `j`
+    // (NK_DRAW_MY_CARD)
+    int k, i, j;
+    // NK_MY_TURN
+    unsigned phase_seen;
+    bool first_layer;
+    bool last_layer;
+    bool cacheable;
+    int root_move;  /* Index of the root move in the order they are tried */
+    long nodes_before;
+    // NK_OPPONENT_TURN
+    unsigned quiet;
+    bool quiet_seen;
+    // NK_DRAW_MY_CARD
+    MoonPhase old_card;
+    int samples;
+    float weights[MoonPhase_NumPhases];
+    float mean;
+#ifdef LUNAR_TRACE
+    int ply;
+    bool trace;
+    double trace_start;
+    long trace_nodes;
+    double move_start;
+#endif
+} SearchFrame;
+
+typedef struct SearchContext {
+    const AIOptions *options;
+    MoonPhase *cards;  /* We will restore after modifying it */
+    int num_cards;  /* Length of `cards` */
+    // `root_depth` frames; the node being searched is `frames[top]`,
+    // and `top` is -1 once the root is done
+    SearchFrame *frames;
+    int top;
+    // Set when a node has just finished with weight `weight`, which
+    // its parent has yet to take
+    bool returned;
+    float weight;
+    AIStats stats;
+    SearchCache *cache;  /* NULL when caching is disabled */
+    bool aborted;
+    AIProgress progress;  /* Only `moves_done` and `moves_total` are kept */
+    // Root moves searched so far, best first; NULL unless ranking.
+    // There are `progress.moves_done` of them.
+    AIRankedMove *ranking;
+    int num_exact;  /* See `AIRankMoves` */
+    int root_depth;
+    // When chance nodes are sampled, weights are estimates. Every node
+    // leaves the variance of its weight here when it finishes; it is 0
+    // when nothing below was sampled.
+    float variance;
+    Random rng;  /* For sampling */
+#ifdef LUNAR_TRACE
+    double trace_start;
+    // Nodes visited at each ply during the current root move; the last
+    // one counts all the plies deeper than that as well
+    long ply_nodes[TRACE_MAX_ARGS];
+    TraceCoreCounters core_before;  /* `Trace_core` at start of move */
+#endif
+} SearchContext;
+
+static bool searchAborted(SearchContext *ctx) {
+    /*
+     * Polled before every child node. Once this returns true, no node
+     * starts another child and every frame cleans up on its way out;
+     * the scores computed after that are meaningless. Root moves that
+     * were finished before still count, though.
+     */
+    if (!ctx->aborted && ctx->options->abort_flag) {
+        ctx->aborted = *ctx->options->abort_flag != 0;
+    }
+    return ctx->aborted;
+}
+
+static int countRootMoves(
+    const GameBoard *board, const MoonPhase *cards, int num_cards
 ) {
-    if (depth == 0) {
-        return heuristic(board);
+    int empty_slots = 0;
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (board->slots[i].phase == MP_NULL) {
+            ++empty_slots;
+        }
     }
-    --depth;
-    float res;
-    GameBoard fork;
-    if (node != NK_DRAW_MY_CARD) {
-        fork.slots = (SlotData *) malloc(board->num_slots * sizeof(SlotData));
+    int phases = 0;
+    unsigned seen = 0;
+    for (int k = 0; k < num_cards; ++k) {
+        if (!(seen & (1u << cards[k]))) {
+            seen |= 1u << cards[k];
+            ++phases;
+        }
+    }
+    return phases * empty_slots;
+}
+
+static void reportProgress(
+    SearchContext *ctx, const AIDecision *best, float score,
+    float score_variance
+) {
+    ++ctx->progress.moves_done;
+    if (ctx->options->on_progress) {
+        ctx->progress.best = *best;
+        ctx->progress.score = score;
+        ctx->progress.score_error = sqrtf(score_variance);
+        ctx->progress.nodes = ctx->stats.nodes;
+        ctx->options->on_progress(
+            &ctx->progress, ctx->options->progress_userdata
+        );
+    }
+}
+
+static float rankingAlpha(const SearchContext *ctx) {
+    /*
+     * Root moves that can't beat this need no exact score: the
+     * `num_exact`th best score so far.
+     */
+    if (ctx->num_exact <= 0 || ctx->progress.moves_done < ctx->num_exact) {
+        return -FLT_MAX;
+    }
+    return ctx->ranking[ctx->num_exact - 1].score;
+}
+
+static float rootAlpha(const SearchContext *ctx, float res) {
+    /*
+     * Root moves that can't beat this can be cut short. A score that
+     * only ties `shared_bound` is still needed exactly, since the move
+     * may come before the one that got it.
+     */
+    if (ctx->ranking) {
+        return rankingAlpha(ctx);
+    }
+    if (ctx->options->shared_bound) {
+        const float bound =
+            nextafterf(*ctx->options->shared_bound, -FLT_MAX);
+        if (bound > res) {
+            return bound;
+        }
+    }
+    return res;
+}
+
+static void rankMove(
+    SearchContext *ctx, int card_id, int slot_id, float weight
+) {
+    /*
+     * Insert a root move into `ctx->ranking`. `ctx->variance` must be
+     * that of `weight`.
+     */
+    AIRankedMove move;
+    move.decision.card_id = card_id;
+    move.decision.slot_id = slot_id;
+    move.score = weight;
+    move.error = sqrtf(ctx->variance);
+    // The search of this move was cut short if it couldn't do better
+    move.exact = weight > rankingAlpha(ctx);
+    int i = ctx->progress.moves_done;
+    // Exact scores go before bounds that are just as high
+    for (; i > 0; --i) {
+        const AIRankedMove *prev = &ctx->ranking[i - 1];
+        if (
+            prev->score > weight
+            || (prev->score == weight && (prev->exact || !move.exact))
+        ) {
+            break;
+        }
+        ctx->ranking[i] = *prev;
+    }
+    ctx->ranking[i] = move;
+}
+
+static void updateCachePeak(SearchContext *ctx) {
+    const size_t used =
+        ctx->cache->live_entries * cacheEntryBytes(ctx->cache->key_len);
+    if (used > ctx->stats.cache_peak_bytes) {
+        ctx->stats.cache_peak_bytes = used;
+    }
+}
+
+#ifdef LUNAR_TRACE
+// Spans are recorded for the nodes (and the `GameBoard_PutCard` and
+// `forkGameBoard` that lead to them) down to `Trace_MaxSpanPly()`
+// plies below the root; counters are recorded per root move.
+
+static const char *const ply_names[TRACE_MAX_ARGS] = {
+    "ply 0", "ply 1", "ply 2", "ply 3", "ply 4", "ply 5", "ply 6", "ply 7+",
+};
+
+static const char *const node_kind_names[] = {
+    "my turn", "opponent turn", "draw my card",
+};
+
+static bool traced(const SearchContext *ctx, int depth) {
+    /* Whether to record spans for a node with `depth` left. */
+    return Trace_IsRecording()
+        && ctx->root_depth - depth <= Trace_MaxSpanPly();
+}
+
+static TraceEvent *traceSpan(const char *name, double start) {
+    TraceEvent *event = Trace_Add('X', "search", name, start);
+    if (event) {
+        event->dur = Trace_Now() - start;
+    }
+    return event;
+}
+
+static void traceStartMove(SearchContext *ctx) {
+    memset(ctx->ply_nodes, 0, sizeof(ctx->ply_nodes));
+    ctx->core_before = Trace_core;
+    Trace_core.lc_max_len = 0;
+}
+
+static void traceEndMove(
+    SearchContext *ctx, MoonPhase phase, int slot_id, float weight,
+    double start, long nodes_before
+) {
+    TraceEvent *event = traceSpan("move", start);
+    TraceEvent_AddArg(event, "phase", phase);
+    TraceEvent_AddArg(event, "slot", slot_id);
+    TraceEvent_AddArg(event, "weight", weight);
+    TraceEvent_AddArg(event, "nodes", ctx->stats.nodes - nodes_before);
+    // Counters are put at the start of the move so that a viewer shows
+    // each value over the span of the move it belongs to
+    event = Trace_Add('C', "search", "nodes per ply", start);
+    for (int i = 0; i < TRACE_MAX_ARGS && i <= ctx->root_depth; ++i) {
+        TraceEvent_AddArg(event, ply_names[i], ctx->ply_nodes[i]);
+    }
+    const TraceCoreCounters *before = &ctx->core_before;
+    event = Trace_Add('C', "core", "lunar cycles", start);
+    TraceEvent_AddArg(
+        event, "PutCard calls", Trace_core.put_cards - before->put_cards
+    );
+    TraceEvent_AddArg(
+        event, "path steps", Trace_core.lc_steps - before->lc_steps
+    );
+    TraceEvent_AddArg(
+        event, "paths", Trace_core.lc_paths - before->lc_paths
+    );
+    TraceEvent_AddArg(event, "longest path", Trace_core.lc_max_len);
+    if (ctx->cache) {
+        event = Trace_Add('C', "cache", "cache", start);
+        TraceEvent_AddArg(event, "live entries", ctx->cache->live_entries);
+        TraceEvent_AddArg(event, "hits", ctx->stats.cache_hits);
+    }
+}
+#endif
+
+static void forkAndPlay(
+    SearchContext *ctx, const GameBoard *board, GameBoard *fork,
+    int slot_id, MoonPhase phase, Player player,
+    int depth  /* What the node after this move has left */
+) {
+    /* Make `fork` a copy of `board`, then put a card on it. */
+#ifdef LUNAR_TRACE
+    const bool trace = traced(ctx, depth);
+    double start = trace ? Trace_Now() : 0;
+#endif
+    forkGameBoard(board, fork);
+#ifdef LUNAR_TRACE
+    if (trace) {
+        traceSpan("fork", start);
+        start = Trace_Now();
+    }
+#endif
+    PatternNode_DeleteChain(GameBoard_PutCard(fork, slot_id, phase, player));
+#ifdef LUNAR_TRACE
+    if (trace) {
+        traceSpan("PutCard", start);
+    }
+#endif
+}
+
+static int sampledDraws(const SearchContext *ctx, int depth) {
+    /*
+     * Number of draws to search at a chance node with `depth` left, or
+     * 0 to search all of them.
+     */
+    const int samples = ctx->options->chance_samples;
+    if (samples < 2 || samples >= MoonPhase_NumPhases) {
+        return 0;
+    }
+    // Chance nodes are 2, 5, 8, ... plies below the root
+    const int layer = (ctx->root_depth - depth - 2) / 3;
+    return layer >= ctx->options->exact_chance_layers ? samples : 0;
+}
+
+static void enterNode(
+    SearchContext *ctx,
+    const GameBoard *board,
+    int played_card,  /* Index in `ctx->cards` */
+    float alpha,  /* For pruning */
+    int depth,
+    NodeKind node,
+    AIDecision *out_result,
+    PrevDecision *prev_decisions,  /* See `SearchFrame` */
+    int pd_ptr
+) {
+    /*
+     * Push a frame for a new node, or finish the node right away if it
+     * has nothing to search.
+     */
+    ++ctx->stats.nodes;
+    ctx->variance = 0;
+#ifdef LUNAR_TRACE
+    const int ply = ctx->root_depth - depth;
+    ++ctx->ply_nodes[ply < TRACE_MAX_ARGS ? ply : TRACE_MAX_ARGS - 1];
+#endif
+    // The second case is a fast path if chance nodes happen to be the
+    // last layer
+    if (depth == 0 || (node == NK_DRAW_MY_CARD && depth == 1)) {
+        ctx->weight = heuristic(board);
+        ctx->returned = true;
+        return;
+    }
+    SearchFrame *f = &ctx->frames[++ctx->top];
+    f->node = node;
+    f->board = board;
+    f->played_card = played_card;
+    f->alpha = alpha;
+    f->depth = depth - 1;
+    f->out_result = out_result;
+    f->prev_decisions = prev_decisions;
+    f->pd_ptr = pd_ptr;
+    f->res_variance = 0;
+#ifdef LUNAR_TRACE
+    f->ply = ply;
+    // Root moves get their own spans from the root
+    f->trace = ply >= 2 && traced(ctx, depth);
+    f->trace_start = f->trace ? Trace_Now() : 0;
+    f->trace_nodes = ctx->stats.nodes;
+#endif
+    if (node != NK_DRAW_MY_CARD && !f->fork.slots) {
+        f->fork.num_slots = board->num_slots;
+        f->fork.slots =
+            (SlotData *) malloc(board->num_slots * sizeof(SlotData));
         for (int i = 0; i < board->num_slots; ++i) {
-            fork.slots[i].lc_predecessors = fork.slots[i].lc_successors = NULL;
+            f->fork.slots[i].lc_predecessors =
+                f->fork.slots[i].lc_successors = NULL;
         }
     }
     switch (node) {
-    case NK_MY_TURN:
-        res = -FLT_MAX;
-        BitSet *phase_seen = BitSet_New(MoonPhase_NumPhases);
-        BitSet_Zero(phase_seen);
-        const bool first_layer = cache == NULL;
-        const bool last_layer = depth <= 2;
+    case NK_MY_TURN: {
+        f->res = -FLT_MAX;
+        f->phase_seen = 0;
+        f->k = -1;
+        f->root_move = -1;
+        f->first_layer = prev_decisions == NULL;
+        f->last_layer = f->depth <= 2;
         // Not the only layer:
-        const bool cacheable = !(first_layer && last_layer);
-        const int expected_layers = depth / 3;
-        CacheHashMeta cache_meta;
-        if (cacheable) {
-            if (first_layer) {
-                prev_decisions = (PrevDecision *)
-                    malloc(sizeof(PrevDecision) * expected_layers);
-                pd_ptr = 0;
+        f->cacheable = !(f->first_layer && f->last_layer);
+        if (!f->cacheable) {
+            break;
+        }
+        if (!f->first_layer) {
+            ++f->pd_ptr;
+            break;
+        }
+        const int expected_layers = f->depth / 3;
+        f->prev_decisions = (PrevDecision *)
+            malloc(sizeof(PrevDecision) * expected_layers);
+        f->pd_ptr = 0;
+        ctx->cache = newSearchCache(
+            ctx->options->cache_limit, expected_layers,
+            board->num_slots * MoonPhase_NumPhases
+        );
+        if (ctx->cache) {
+            ctx->stats.cache_bytes = cacheBytes(ctx->cache);
+#ifdef LUNAR_TRACE
+            TraceEvent_AddArg(
+                Trace_Add('i', "cache", "new cache", Trace_Now()),
+                "bytes", ctx->stats.cache_bytes
+            );
+#endif
+        }
+        break;
+    }
+    case NK_OPPONENT_TURN:
+        f->res = FLT_MAX;
+        f->i = -1;
+        f->j = MoonPhase_NumPhases;
+        break;
+    case NK_DRAW_MY_CARD:
+        f->res = 0;
+        f->j = 0;
+        f->old_card = ctx->cards[played_card];
+        f->samples = sampledDraws(ctx, depth);
+        f->mean = 0;
+        break;
+    }
+}
+
+static void leaveNode(SearchContext *ctx, SearchFrame *f) {
+    /* Pop `f`, leaving its weight for its parent. */
+    switch (f->node) {
+    case NK_MY_TURN:
+        if (f->cacheable && f->first_layer) {
+            free(f->prev_decisions);
+            if (ctx->cache) {
+                deleteSearchCache(ctx->cache);
+                ctx->cache = NULL;
+            }
+        }
+        if (f->res == -FLT_MAX) {  // Full game board
+            f->res = heuristic(f->board);
+        }
+        break;
+    case NK_OPPONENT_TURN:
+        if (f->res == FLT_MAX) {  // Full game board
+            f->res = heuristic(f->board);
+        }
+        break;
+    case NK_DRAW_MY_CARD:
+        if (f->samples == 0) {
+            f->res /= MoonPhase_NumPhases;
+            f->res_variance /= MoonPhase_NumPhases * MoonPhase_NumPhases;
+        }
+        else if (f->j == f->samples) {  // Not aborted
+            // Sampling error, estimated as for simple random sampling
+            // without replacement
+            float spread = 0;
+            for (int h = 0; h < f->samples; ++h) {
+                spread += (f->weights[h] - f->mean)
+                    * (f->weights[h] - f->mean);
             }
-            else {
-                ++pd_ptr;
+            spread /= f->samples - 1;
+            f->res_variance += spread / f->samples
+                * (1 - (float) f->samples / MoonPhase_NumPhases);
+        }
+        ctx->cards[f->played_card] = f->old_card;
+        break;
+    }
+#ifdef LUNAR_TRACE
+    if (f->trace) {
+        TraceEvent *event =
+            traceSpan(node_kind_names[f->node], f->trace_start);
+        TraceEvent_AddArg(event, "ply", f->ply);
+        TraceEvent_AddArg(event, "nodes", ctx->stats.nodes - f->trace_nodes);
+    }
+#endif
+    ctx->variance = f->res_variance;
+    ctx->weight = f->res;
+    ctx->returned = true;
+    --ctx->top;
+}
+
+static bool nextMove(SearchContext *ctx, SearchFrame *f) {
+    /*
+     * Move an NK_MY_TURN node on to the next card and empty slot to
+     * try, or return false if there are none left. Only the first card
+     * of each phase is tried.
+     */
+    const GameBoard *board = f->board;
+    for (;;) {
+        if (f->k < 0 || ++f->i == board->num_slots) {
+            do {
+                ++f->k;
+            } while (
+                f->k < ctx->num_cards
+                && (f->phase_seen & (1u << ctx->cards[f->k]))
+            );
+            if (f->k == ctx->num_cards || searchAborted(ctx)) {
+                return false;
             }
+            f->phase_seen |= 1u << ctx->cards[f->k];
+            f->i = 0;
         }
-        for (int k = 0; k < num_cards; ++k) {
-            const MoonPhase phase = cards[k];
-            if (BitSet_Get(phase_seen, (int) phase)) {
-                continue;
+        if (board->slots[f->i].phase != MP_NULL) {
+            continue;
+        }
+        if (
+            f->out_result
+            && ++f->root_move % ctx->options->root_split
+                != ctx->options->root_part
+        ) {
+            continue;
+        }
+        return !searchAborted(ctx);
+    }
+}
+
+static void settleMove(SearchContext *ctx, SearchFrame *f, float weight) {
+    /*
+     * Take the weight of the move an NK_MY_TURN node has tried.
+     * `ctx->variance` must be that of `weight`.
+     */
+    if (weight > f->res) {
+        f->res = weight;
+        f->res_variance = ctx->variance;
+        if (f->out_result) {
+            f->out_result->card_id = f->k;
+            f->out_result->slot_id = f->i;
+        }
+    }
+    if (f->out_result) {
+        if (ctx->ranking) {
+            rankMove(ctx, f->k, f->i, weight);
+        }
+        reportProgress(ctx, f->out_result, f->res, f->res_variance);
+    }
+}
+
+static bool nextChild(SearchContext *ctx, SearchFrame *f) {
+    /*
+     * Start the next child of `f`, or return false if `f` is done. The
+     * children whose weight is known without searching them are
+     * settled on the way.
+     */
+    const GameBoard *board = f->board;
+    switch (f->node) {
+    case NK_MY_TURN:
+        while (nextMove(ctx, f)) {
+            const MoonPhase phase = ctx->cards[f->k];
+            f->nodes_before = ctx->stats.nodes;
+#ifdef LUNAR_TRACE
+            f->move_start = f->out_result ? Trace_Now() : 0;
+            if (f->out_result) {
+                traceStartMove(ctx);
             }
-            BitSet_Set(phase_seen, (int) phase);
-            for (int i = 0; i < board->num_slots; ++i) {
-                if (board->slots[i].phase != MP_NULL) {
-                    continue;
-                }
-                float weight;
-                if (cacheable) {
-                    if (first_layer) {
-                        cache_meta.len = expected_layers;
-                        cache_meta.total_states =
-                            board->num_slots * MoonPhase_NumPhases;
-                        cache = HashMap_New(
-                            cacheHash, cacheEq, (void *) &cache_meta
-                        );
-#if AI_DEBUG
-                        printf("New cache phase=%d slot=%d\n", phase, i);
 #endif
-                    }
-                    else {
-                        PrevDecision *decision = &prev_decisions[pd_ptr - 1];
-                        decision->phase = phase;
-                        decision->slot_id = i;
-                    }
-                    if (last_layer) {
-                        void *weight_ptr = HashMap_GetOr(
-                            cache, (void *) prev_decisions, NULL
-                        );
-                        if (weight_ptr) {
-                            weight = *(float *) weight_ptr;
+            if (f->cacheable && !f->first_layer) {
+                PrevDecision *decision = &f->prev_decisions[f->pd_ptr - 1];
+                decision->phase = phase;
+                decision->slot_id = f->i;
+            }
+            if (ctx->cache) {
+                if (f->first_layer) {
+                    cacheNextGeneration(ctx->cache);
 #if AI_DEBUG
-                            printf("CacheHit %f ", weight);
-                            printPrevDecisions(prev_decisions, pd_ptr);
-                            putchar('\n');
+                    printf("New cache phase=%d slot=%d\n", phase, f->i);
 #endif
-                            goto weight_finished;
-                        }
-                    }
                 }
-                forkGameBoard(board, &fork);
-                PatternNode_DeleteChain(GameBoard_PutCard(
-                    &fork, i, phase, P_BLACK
-                ));
-                weight = expectiminimax(
-                    &fork, cards, num_cards, k, res,
-                    depth, NK_OPPONENT_TURN, NULL, cache, prev_decisions,
-                    pd_ptr
-                );
-#ifdef LUNAR_EMCC_TAKE_A_BREAK
-                take_a_break();
-#endif
-                if (cacheable) {
-                    if (last_layer) {
-                        float *weight_ptr = (float *) malloc(sizeof(float));
-                        *weight_ptr = weight;
-                        // pd_ptr == length of prev_decisions in last layer
-                        size_t size = sizeof(PrevDecision) * pd_ptr;
-                        PrevDecision *pd_copy = (PrevDecision *) malloc(size);
-                        memcpy(pd_copy, prev_decisions, size);
-                        HashMap_Insert(
-                            cache, (void *) pd_copy, (void *) weight_ptr
-                        );
+                else if (f->last_layer) {
+                    const CacheEntry *entry =
+                        cacheLookup(ctx->cache, f->prev_decisions);
+                    if (entry) {
+                        ctx->variance = entry->variance;
+                        ++ctx->stats.cache_hits;
 #if AI_DEBUG
-                        printf("CacheMiss %f ", weight);
-                        printPrevDecisions(pd_copy, pd_ptr);
+                        printf("CacheHit %f ", entry->weight);
+                        printPrevDecisions(f->prev_decisions, f->pd_ptr);
                         putchar('\n');
 #endif
+                        settleMove(ctx, f, entry->weight);
+                        continue;
                     }
-                    if (first_layer) {
-                        HashMap_ITER_ENTRIES(cache, pair)
-                            free(pair->key);
-                            free(pair->value);
-                        HashMap_ITER_END
-                        HashMap_Delete(cache);
-                    }
                 }
-weight_finished:
-                if (weight > res) {
-                    res = weight;
-                    if (out_result) {
-                        out_result->card_id = k;
-                        out_result->slot_id = i;
+            }
+            forkAndPlay(ctx, board, &f->fork, f->i, phase, P_BLACK, f->depth);
+            enterNode(
+                ctx, &f->fork, f->k,
+                f->out_result ? rootAlpha(ctx, f->res) : f->res,
+                f->depth, NK_OPPONENT_TURN, NULL,
+                f->prev_decisions, f->pd_ptr
+            );
+            return true;
+        }
+        return false;
+    case NK_OPPONENT_TURN:
+        for (;;) {
+            if (!(f->res > f->alpha) || searchAborted(ctx)) {
+                return false;
+            }
+            if (f->j == MoonPhase_NumPhases) {
+                do {
+                    ++f->i;
+                } while (
+                    f->i < board->num_slots
+                    && board->slots[f->i].phase != MP_NULL
+                );
+                if (f->i == board->num_slots) {
+                    return false;
+                }
+                f->j = 0;
+                // At the frontier, phases that don't relate to any
+                // neighbor all leave the board's evaluation as it is
+                // now
+                f->quiet = 0;
+                f->quiet_seen = false;
+                if (f->depth <= 1) {
+                    f->quiet = ~GameBoard_RelatedPhases(board, f->i)
+                        & ((1u << MoonPhase_NumPhases) - 1);
+                }
+            }
+            const int j = f->j++;
+            if (f->quiet & (1u << j)) {
+                // Evaluate the first of them only
+                if (!f->quiet_seen) {
+                    const float weight = heuristic(board);
+                    if (weight < f->res) {
+                        f->res = weight;
+                        f->res_variance = 0;
                     }
+                    f->quiet_seen = true;
+                }
+                continue;
+            }
+            // The other phases only form pairs there unless they
+            // extend a Lunar Cycle path, so their outcome can be worked
+            // out without playing them
+            CardOutcome outcome;
+            if (
+                f->depth <= 1
+                && GameBoard_CardOutcome(
+                    board, f->i, (MoonPhase) j, P_WHITE, &outcome
+                )
+            ) {
+                const float weight = evaluate(
+                    outcome.black_stars, outcome.white_stars,
+                    outcome.perks, outcome.claimed
+                );
+                if (weight < f->res) {
+                    f->res = weight;
+                    f->res_variance = 0;
                 }
+                continue;
             }
+            forkAndPlay(
+                ctx, board, &f->fork, f->i, (MoonPhase) j, P_WHITE, f->depth
+            );
+            enterNode(
+                ctx, &f->fork, f->played_card, 0, f->depth,
+                NK_DRAW_MY_CARD, NULL, f->prev_decisions, f->pd_ptr
+            );
+            return true;
         }
-        if (cacheable && first_layer) {
-            free(prev_decisions);
+    case NK_DRAW_MY_CARD:
+        if (
+            f->j == (f->samples ? f->samples : MoonPhase_NumPhases)
+            || searchAborted(ctx)
+        ) {
+            return false;
         }
-        BitSet_Delete(phase_seen);
-        if (res == -FLT_MAX) {  // Full game board
-            res = heuristic(board);
+        if (f->samples == 0) {
+            ctx->cards[f->played_card] = (MoonPhase) f->j;
+        }
+        else {
+            // Stratified sampling: split the phases into `samples`
+            // groups as equal as possible and draw one from each
+            const int lo = f->j * MoonPhase_NumPhases / f->samples;
+            const int size =
+                (f->j + 1) * MoonPhase_NumPhases / f->samples - lo;
+            ctx->cards[f->played_card] =
+                (MoonPhase) (lo + Random_Below(&ctx->rng, size));
+        }
+        enterNode(
+            ctx, board, -1, 0, f->depth, NK_MY_TURN, NULL,
+            f->prev_decisions, f->pd_ptr
+        );
+        return true;
+    }
+    return false;
+}
+
+static void childDone(SearchContext *ctx, SearchFrame *f, float weight) {
+    /*
+     * Take the weight of the child `f` has searched. `ctx->variance`
+     * is that of `weight`.
+     */
+    switch (f->node) {
+    case NK_MY_TURN:
+        if (ctx->aborted) {
+            // `weight` is incomplete; keep what we had. `nextMove`
+            // stops there.
+            return;
+        }
+#ifdef LUNAR_TRACE
+        if (f->out_result) {
+            traceEndMove(
+                ctx, ctx->cards[f->k], f->i, weight, f->move_start,
+                f->nodes_before
+            );
         }
-        break;
-    case NK_OPPONENT_TURN:
-        res = FLT_MAX;
-        for (int i = 0; i < board->num_slots; ++i) {
-            if (board->slots[i].phase != MP_NULL) {
-                continue;
-            }
-            for (int j = 0; j < MoonPhase_NumPhases && res > alpha; ++j) {
-                forkGameBoard(board, &fork);
-                PatternNode_DeleteChain(GameBoard_PutCard(
-                    &fork, i, (MoonPhase) j, P_WHITE
-                ));
-                res = fminf(res, expectiminimax(
-                    &fork, cards, num_cards, played_card, 0,
-                    depth, NK_DRAW_MY_CARD, NULL, cache, prev_decisions,
-                    pd_ptr
-                ));
-#ifdef LUNAR_EMCC_TAKE_A_BREAK
-                take_a_break();
 #endif
-            }
+        if (ctx->cache && f->last_layer) {
+            // pd_ptr == length of prev_decisions in last layer
+            cacheStore(
+                ctx->cache, f->prev_decisions, weight, ctx->variance,
+                ctx->stats.nodes - f->nodes_before
+            );
+            updateCachePeak(ctx);
+#if AI_DEBUG
+            printf("CacheMiss %f ", weight);
+            printPrevDecisions(f->prev_decisions, f->pd_ptr);
+            putchar('\n');
+#endif
         }
-        if (res == FLT_MAX) {  // Full game board
-            res = heuristic(board);
+        settleMove(ctx, f, weight);
+        break;
+    case NK_OPPONENT_TURN:
+        if (weight < f->res) {
+            f->res = weight;
+            f->res_variance = ctx->variance;
         }
         break;
     case NK_DRAW_MY_CARD:
-        if (depth == 0) {
-            // Fast path if chance nodes happen to be the last layer
-            return heuristic(board);
-        }
-        res = 0;
-        MoonPhase old_card = cards[played_card];
-        for (int j = 0; j < MoonPhase_NumPhases; ++j) {
-            cards[played_card] = (MoonPhase) j;
-            res += expectiminimax(
-                board, cards, num_cards, -1, 0,
-                depth, NK_MY_TURN, NULL, cache, prev_decisions,
-                pd_ptr
-            );
+        if (f->samples == 0) {
+            f->res += weight;
+            f->res_variance += ctx->variance;
+        }
+        else {
+            const int lo = f->j * MoonPhase_NumPhases / f->samples;
+            const int size =
+                (f->j + 1) * MoonPhase_NumPhases / f->samples - lo;
+            const float share = (float) size / MoonPhase_NumPhases;
+            f->weights[f->j] = weight;
+            f->res += share * weight;
+            f->res_variance += share * share * ctx->variance;
+            f->mean += weight / f->samples;
         }
-        cards[played_card] = old_card;
-        res /= MoonPhase_NumPhases;
+        ++f->j;
         break;
     }
-    if (node != NK_DRAW_MY_CARD) {
-        for (int i = 0; i < board->num_slots; ++i) {
-            SlotData_Deinit(&fork.slots[i]);
+}
+
+static bool runSearch(SearchContext *ctx, long node_budget) {
+    /*
+     * Search until the root is done, then return true, or until
+     * `node_budget` more nodes have been visited.
+     */
+    const long nodes_before = ctx->stats.nodes;
+    while (ctx->top >= 0) {
+        if (ctx->stats.nodes - nodes_before >= node_budget) {
+            return false;
+        }
+        SearchFrame *f = &ctx->frames[ctx->top];
+        if (ctx->returned) {
+            ctx->returned = false;
+            childDone(ctx, f, ctx->weight);
+        }
+        else if (!nextChild(ctx, f)) {
+            leaveNode(ctx, f);
         }
-        free(fork.slots);
     }
-    return res;
+    return true;
+}
+
+static void beginSearch(
+    SearchContext *ctx, const GameBoard *board, MoonPhase *choices,
+    int num_choices, int depth, const AIOptions *options,
+    AIRankedMove *ranking, AIDecision *out_best
+) {
+    /* `ctx->num_exact` must be set when `ranking` is not NULL. */
+    ctx->options = options;
+    ctx->cards = choices;
+    ctx->num_cards = num_choices;
+    ctx->cache = NULL;
+    ctx->aborted = false;
+    ctx->ranking = ranking;
+    ctx->root_depth = depth;
+    Random_Seed(&ctx->rng, options->sample_seed);
+    memset(&ctx->stats, 0, sizeof(AIStats));
+    memset(&ctx->progress, 0, sizeof(AIProgress));
+    const int split = options->root_split;
+    ctx->progress.moves_total =
+        (countRootMoves(board, choices, num_choices) - options->root_part
+            + split - 1) / split;
+#ifdef LUNAR_TRACE
+    ctx->trace_start = Trace_Now();
+#endif
+    ctx->frames = (SearchFrame *)
+        malloc((depth > 0 ? depth : 1) * sizeof(SearchFrame));
+    for (int i = 0; i < depth; ++i) {
+        ctx->frames[i].fork.slots = NULL;
+    }
+    ctx->top = -1;
+    ctx->returned = false;
+    enterNode(
+        ctx, board, -1, 0, depth, NK_MY_TURN, out_best, NULL, -1
+    );
+}
+
+static void endSearch(SearchContext *ctx, AIStats *out_stats) {
+    /* Free what `beginSearch` allocated, once `runSearch` is done. */
+    for (int i = 0; i < ctx->root_depth; ++i) {
+        GameBoard *fork = &ctx->frames[i].fork;
+        if (!fork->slots) {
+            continue;
+        }
+        for (int j = 0; j < fork->num_slots; ++j) {
+            SlotData_Deinit(&fork->slots[j]);
+        }
+        free(fork->slots);
+    }
+    free(ctx->frames);
+    if (out_stats) {
+        *out_stats = ctx->stats;
+    }
+#ifdef LUNAR_TRACE
+    TraceEvent *event = traceSpan(
+        ctx->ranking ? "AIRankMoves" : "AIMove", ctx->trace_start
+    );
+    TraceEvent_AddArg(event, "depth", ctx->root_depth);
+    TraceEvent_AddArg(event, "nodes", ctx->stats.nodes);
+    TraceEvent_AddArg(event, "cache hits", ctx->stats.cache_hits);
+    TraceEvent_AddArg(event, "cache bytes", ctx->stats.cache_bytes);
+    TraceEvent_AddArg(event, "aborted", ctx->aborted);
+#endif
+}
+
+static void search(
+    SearchContext *ctx, const GameBoard *board, MoonPhase *choices,
+    int num_choices, int depth, const AIOptions *options,
+    AIRankedMove *ranking, AIDecision *out_best, AIStats *out_stats
+) {
+    /* Search all in one go. */
+    beginSearch(
+        ctx, board, choices, num_choices, depth, options, ranking, out_best
+    );
+    runSearch(ctx, LONG_MAX);
+    endSearch(ctx, out_stats);
+}
+
+AIDecision *AIMoveWithOptions(
+    const GameBoard *board,
+    MoonPhase *choices,  /* We modify it but will restore it */
+    int num_choices,
+    int depth,
+    const AIOptions *options,
+    AIStats *out_stats  /* May be NULL */
+) {
+    /*
+     * If aborted through `options->abort_flag`, return the best move
+     * among the root moves that were fully searched, or NULL if there
+     * isn't one yet.
+     */
+    SearchContext ctx;
+    AIDecision *d = (AIDecision *) malloc(sizeof(AIDecision));
+    search(
+        &ctx, board, choices, num_choices, depth, options, NULL, d, out_stats
+    );
+    if (ctx.aborted && ctx.progress.moves_done == 0) {
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+AIRankedMove *AIRankMoves(
+    const GameBoard *board,
+    MoonPhase *choices,  /* We modify it but will restore it */
+    int num_choices,
+    int depth,
+    // Number of best moves that must have exact scores, or 0 for all
+    int num_exact,
+    const AIOptions *options,
+    int *out_num_moves,
+    AIStats *out_stats  /* May be NULL */
+) {
+    /*
+     * Return every move `AIMove` considers (one per phase in `choices`
+     * and empty slot), best first, from a single search. Moves that
+     * can't make it into the best `num_exact` are only searched as far
+     * as needed to show that, so their scores are upper bounds; they
+     * have `exact` cleared. 1 costs as much as `AIMove`, 0 as much as
+     * searching every move without pruning at the root.
+     *
+     * If aborted, only the moves searched so far are returned; NULL
+     * if there are none. The caller must free the result.
+     */
+    SearchContext ctx;
+    ctx.num_exact = num_exact;
+    AIRankedMove *ranking = (AIRankedMove *) malloc(
+        countRootMoves(board, choices, num_choices) * sizeof(AIRankedMove)
+    );
+    AIDecision best;
+    search(
+        &ctx, board, choices, num_choices, depth, options, ranking, &best,
+        out_stats
+    );
+    *out_num_moves = ctx.progress.moves_done;
+    if (ctx.progress.moves_done == 0) {
+        free(ranking);
+        return NULL;
+    }
+    return ranking;
 }
 
 AIDecision *AIMove(
@@ -333,13 +1206,156 @@ AIDecision *AIMove(
     int num_choices,
     int depth
 ) {
-#ifdef LUNAR_EMCC_TAKE_A_BREAK
-    counter = 0;
-#endif
-    AIDecision *d = (AIDecision *) malloc(sizeof(AIDecision));
-    expectiminimax(
-        board, choices, num_choices, -1, 0,
-        depth, NK_MY_TURN, d, NULL, NULL, -1
+    AIOptions options;
+    AIOptions_Init(&options);
+    return AIMoveWithOptions(
+        board, choices, num_choices, depth, &options, NULL
     );
+}
+
+struct AISearch {
+    SearchContext ctx;
+    AIOptions options;
+    GameBoard board;  /* A fork of the board searched */
+    MoonPhase *choices;
+    AIDecision best;
+    AIRankedMove *ranking;  /* NULL unless from `AISearch_BeginRanking` */
+    bool done;
+};
+
+static AISearch *newAISearch(
+    const GameBoard *board, const MoonPhase *choices, int num_choices,
+    int depth, const AIOptions *options, bool rank, int num_exact
+) {
+    AISearch *search = (AISearch *) malloc(sizeof(AISearch));
+    if (options) {
+        search->options = *options;
+    }
+    else {
+        AIOptions_Init(&search->options);
+    }
+    search->board.slots =
+        (SlotData *) malloc(board->num_slots * sizeof(SlotData));
+    for (int i = 0; i < board->num_slots; ++i) {
+        search->board.slots[i].lc_predecessors =
+            search->board.slots[i].lc_successors = NULL;
+    }
+    forkGameBoard(board, &search->board);
+    search->choices = (MoonPhase *) malloc(num_choices * sizeof(MoonPhase));
+    memcpy(search->choices, choices, num_choices * sizeof(MoonPhase));
+    search->done = false;
+    search->ranking = NULL;
+    if (rank) {
+        search->ctx.num_exact = num_exact;
+        search->ranking = (AIRankedMove *) malloc(
+            countRootMoves(board, choices, num_choices)
+                * sizeof(AIRankedMove)
+        );
+    }
+    beginSearch(
+        &search->ctx, &search->board, search->choices, num_choices, depth,
+        &search->options, search->ranking, &search->best
+    );
+    return search;
+}
+
+AISearch *AISearch_Begin(
+    const GameBoard *board,
+    const MoonPhase *choices,
+    int num_choices,
+    int depth,
+    const AIOptions *options  /* May be NULL for the defaults */
+) {
+    /*
+     * Set up the search of `AIMoveWithOptions` without running any of
+     * it; the host then runs it a slice at a time with `AISearch_Step`
+     * and keeps a page responsive in between. `board` and `choices` are
+     * copied, so they may change in the meantime, but the edges of
+     * `board` must stay. Delete the result with `AISearch_Delete`.
+     */
+    return newAISearch(
+        board, choices, num_choices, depth, options, false, 0
+    );
+}
+
+AISearch *AISearch_BeginRanking(
+    const GameBoard *board,
+    const MoonPhase *choices,
+    int num_choices,
+    int depth,
+    int num_exact,
+    const AIOptions *options  /* May be NULL for the defaults */
+) {
+    /*
+     * Like `AISearch_Begin`, but for the search of `AIRankMoves`, whose
+     * ranking `AISearch_Ranking` returns.
+     */
+    return newAISearch(
+        board, choices, num_choices, depth, options, true, num_exact
+    );
+}
+
+bool AISearch_Step(AISearch *search, long node_budget) {
+    /*
+     * Visit up to `node_budget` more nodes of the search and return
+     * whether it is done. The progress callback and abort flag of the
+     * options work as in one go; a step after the flag is set finishes
+     * the search.
+     */
+    if (!search->done && runSearch(&search->ctx, node_budget)) {
+        search->done = true;
+        endSearch(&search->ctx, NULL);
+    }
+    return search->done;
+}
+
+AIDecision *AISearch_Result(const AISearch *search, AIStats *out_stats) {
+    /*
+     * Return the best of the root moves searched so far, which is the
+     * move `AIMoveWithOptions` returns once the search is done, or NULL
+     * if there are none yet. The caller must free it.
+     */
+    if (out_stats) {
+        *out_stats = search->ctx.stats;
+    }
+    if (search->ctx.progress.moves_done == 0) {
+        return NULL;
+    }
+    AIDecision *d = (AIDecision *) malloc(sizeof(AIDecision));
+    *d = search->best;
     return d;
 }
+
+AIRankedMove *AISearch_Ranking(const AISearch *search, int *out_num_moves) {
+    /*
+     * Return the root moves ranked so far by a search of
+     * `AISearch_BeginRanking`, which are those of `AIRankMoves` once the
+     * search is done, or NULL if there are none yet. The caller must
+     * free it.
+     */
+    const int n = search->ctx.progress.moves_done;
+    *out_num_moves = n;
+    if (n == 0) {
+        return NULL;
+    }
+    AIRankedMove *ranking =
+        (AIRankedMove *) malloc(n * sizeof(AIRankedMove));
+    memcpy(ranking, search->ranking, n * sizeof(AIRankedMove));
+    return ranking;
+}
+
+void AISearch_Delete(AISearch *search) {
+    /* The search may be deleted before it is done. */
+    if (!search->done) {
+        search->ctx.aborted = true;
+        runSearch(&search->ctx, LONG_MAX);
+        endSearch(&search->ctx, NULL);
+    }
+    for (int i = 0; i < search->board.num_slots; ++i) {
+        SlotData_Deinit(&search->board.slots[i]);
+    }
+    free(search->board.slots);
+    free(search->choices);
+    free(search->ranking);
+    free(search);
+}
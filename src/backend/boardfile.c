@@ -0,0 +1,339 @@
+#include "lunar_game.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Boards loaded at run time from text in the syntax of boards_data.inc
+
+typedef struct Parser {
+    const char *p;
+    int line;
+    char *error;
+    int error_size;
+    bool failed;
+} Parser;
+
+static void fail(Parser *parser, const char *format, ...) {
+    if (parser->failed) {
+        return;
+    }
+    parser->failed = true;
+    const int n = snprintf(
+        parser->error, parser->error_size, "line %d: ", parser->line
+    );
+    if (n >= 0 && n < parser->error_size) {
+        va_list ap;
+        va_start(ap, format);
+        vsnprintf(parser->error + n, parser->error_size - n, format, ap);
+        va_end(ap);
+    }
+}
+
+static void skipBlanks(Parser *parser) {
+    for (;;) {
+        const char c = *parser->p;
+        if (c == '\n') {
+            ++parser->line;
+        }
+        if (isspace((unsigned char) c)) {
+            ++parser->p;
+        }
+        else if (c == '/' && parser->p[1] == '/') {
+            while (*parser->p && *parser->p != '\n') {
+                ++parser->p;
+            }
+        }
+        else {
+            return;
+        }
+    }
+}
+
+static bool peekWord(Parser *parser, const char *word) {
+    skipBlanks(parser);
+    const size_t len = strlen(word);
+    return !strncmp(parser->p, word, len)
+        && !isalnum((unsigned char) parser->p[len]) && parser->p[len] != '_';
+}
+
+static void expectWord(Parser *parser, const char *word) {
+    if (!parser->failed && !peekWord(parser, word)) {
+        fail(parser, "expected %s", word);
+    }
+    if (!parser->failed) {
+        parser->p += strlen(word);
+    }
+}
+
+static void expectChar(Parser *parser, char c) {
+    skipBlanks(parser);
+    if (!parser->failed && *parser->p != c) {
+        fail(parser, "expected '%c'", c);
+    }
+    if (!parser->failed) {
+        ++parser->p;
+    }
+}
+
+static int expectInt(Parser *parser) {
+    skipBlanks(parser);
+    if (parser->failed) {
+        return 0;
+    }
+    char *end;
+    const long value = strtol(parser->p, &end, 10);
+    if (end == parser->p || value < -1000000 || value > 1000000) {
+        fail(parser, "expected a number");
+        return 0;
+    }
+    parser->p = end;
+    return (int) value;
+}
+
+static void expectName(Parser *parser, char *out, int capacity) {
+    skipBlanks(parser);
+    int len = 0;
+    while (
+        isalnum((unsigned char) parser->p[len]) || parser->p[len] == '_'
+    ) {
+        ++len;
+    }
+    if (!parser->failed && (len == 0 || len >= capacity)) {
+        fail(parser, "expected a name of up to %d characters", capacity - 1);
+    }
+    if (!parser->failed) {
+        memcpy(out, parser->p, len);
+        out[len] = '\0';
+        parser->p += len;
+    }
+}
+
+static bool hasEdge(const GameBoard *board, int id1, int id2) {
+    for (const SlotNode *node = board->adj[id1]; node; node = node->next) {
+        if (node->slot_id == id2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int countComponents(const GameBoard *board) {
+    const int n = board->num_slots;
+    int *stack = (int *) malloc(n * sizeof(int));
+    BitSet *seen = BitSet_New(n);
+    BitSet_Zero(seen);
+    int components = 0;
+    for (int i = 0; i < n; ++i) {
+        if (BitSet_Get(seen, i)) {
+            continue;
+        }
+        ++components;
+        int top = 0;
+        stack[top++] = i;
+        BitSet_Set(seen, i);
+        while (top) {
+            const int slot = stack[--top];
+            for (SlotNode *node = board->adj[slot]; node; node = node->next) {
+                if (!BitSet_Get(seen, node->slot_id)) {
+                    BitSet_Set(seen, node->slot_id);
+                    stack[top++] = node->slot_id;
+                }
+            }
+        }
+    }
+    BitSet_Delete(seen);
+    free(stack);
+    return components;
+}
+
+static void parseBoard(Parser *parser, LoadedBoard *out) {
+    expectWord(parser, "BOARD_BEGIN");
+    expectChar(parser, '(');
+    expectName(parser, out->name, sizeof(out->name));
+    expectChar(parser, ',');
+    const int n = expectInt(parser);
+    expectChar(parser, ')');
+    if (!parser->failed && (n < 1 || n > LOADED_BOARD_MAX_SLOTS)) {
+        fail(parser, "a board has 1 to %d slots", LOADED_BOARD_MAX_SLOTS);
+    }
+    if (parser->failed) {
+        return;
+    }
+    out->layout = GameBoard_New(n);
+    while (!parser->failed && peekWord(parser, "EDGE")) {
+        expectWord(parser, "EDGE");
+        expectChar(parser, '(');
+        const int id1 = expectInt(parser);
+        expectChar(parser, ',');
+        const int id2 = expectInt(parser);
+        expectChar(parser, ')');
+        if (parser->failed) {
+            break;
+        }
+        if (id1 < 0 || id1 >= n || id2 < 0 || id2 >= n) {
+            fail(parser, "no slot %d", id1 < 0 || id1 >= n ? id1 : id2);
+        }
+        else if (id1 == id2) {
+            fail(parser, "slot %d is linked to itself", id1);
+        }
+        else if (hasEdge(out->layout, id1, id2)) {
+            fail(parser, "slots %d and %d are linked twice", id1, id2);
+        }
+        else {
+            GameBoard_AddEdge(out->layout, id1, id2);
+            ++out->num_edges;
+        }
+    }
+    expectWord(parser, "BOARD_END");
+    char name[sizeof(out->name)];
+    expectWord(parser, "DISPLAY_BEGIN");
+    expectChar(parser, '(');
+    expectName(parser, name, sizeof(name));
+    expectChar(parser, ',');
+    out->x_len = expectInt(parser);
+    expectChar(parser, ',');
+    out->y_len = expectInt(parser);
+    expectChar(parser, ')');
+    if (!parser->failed && strcmp(name, out->name)) {
+        fail(parser, "display of %s, not %s", name, out->name);
+    }
+    if (!parser->failed && (out->x_len < 1 || out->y_len < 1)) {
+        fail(parser, "the display must be at least 1 by 1");
+    }
+    out->slot_pos = (SlotPos *) malloc(n * sizeof(SlotPos));
+    int num_pos = 0;
+    while (!parser->failed && peekWord(parser, "POS")) {
+        expectWord(parser, "POS");
+        expectChar(parser, '(');
+        const int x = expectInt(parser);
+        expectChar(parser, ',');
+        const int y = expectInt(parser);
+        expectChar(parser, ')');
+        if (parser->failed) {
+            break;
+        }
+        if (num_pos == n) {
+            fail(parser, "more positions than slots");
+        }
+        else if (x < 0 || x > out->x_len || y < 0 || y > out->y_len) {
+            fail(parser, "position out of the display");
+        }
+        else {
+            out->slot_pos[num_pos].x = x;
+            out->slot_pos[num_pos].y = y;
+            ++num_pos;
+        }
+    }
+    expectWord(parser, "DISPLAY_END");
+    if (!parser->failed && num_pos != n) {
+        fail(parser, "%d positions for %d slots", num_pos, n);
+    }
+    for (int i = 0; !parser->failed && i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            if (
+                out->slot_pos[i].x == out->slot_pos[j].x
+                && out->slot_pos[i].y == out->slot_pos[j].y
+            ) {
+                fail(parser, "slots %d and %d are at the same place", i, j);
+                break;
+            }
+        }
+    }
+    skipBlanks(parser);
+    if (!parser->failed && *parser->p) {
+        fail(parser, "expected the end after DISPLAY_END");
+    }
+}
+
+static void relabel(LoadedBoard *board) {
+    /* Renumber the slots with `Slots_LocalOrder`. */
+    const GameBoard *layout = board->layout;
+    const int n = layout->num_slots;
+    int *edges = (int *) malloc((2 * board->num_edges + 1) * sizeof(int));
+    int len = 0;
+    for (int i = 0; i < n; ++i) {
+        for (const SlotNode *node = layout->adj[i]; node; node = node->next) {
+            if (node->slot_id > i) {
+                edges[len++] = i;
+                edges[len++] = node->slot_id;
+            }
+        }
+    }
+    edges[len] = -1;
+    int *new_ids = (int *) malloc(n * sizeof(int));
+    GameBoard *relabeled = GameBoard_FromEdgesRelabeled(n, edges, new_ids);
+    SlotPos *slot_pos = (SlotPos *) malloc(n * sizeof(SlotPos));
+    board->file_ids = (int *) malloc(n * sizeof(int));
+    for (int i = 0; i < n; ++i) {
+        slot_pos[new_ids[i]] = board->slot_pos[i];
+        board->file_ids[new_ids[i]] = i;
+    }
+    GameBoard_Delete(board->layout);
+    free(board->slot_pos);
+    board->layout = relabeled;
+    board->slot_pos = slot_pos;
+    free(new_ids);
+    free(edges);
+}
+
+LoadedBoard *LoadedBoard_Parse(const char *text, char *error, int error_size) {
+    /*
+     * Load one board written like those in boards_data.inc: a
+     * BOARD_BEGIN ... BOARD_END block and then its DISPLAY_BEGIN ...
+     * DISPLAY_END block, with `//` comments allowed. Return NULL and
+     * put a message in `error` if the text or the board is not valid.
+     * Boards of `LOADED_BOARD_RELABEL_SLOTS` slots or more are
+     * renumbered so that neighbors get close IDs; `file_ids` then maps
+     * them back.
+     */
+    LoadedBoard *board = (LoadedBoard *) malloc(sizeof(LoadedBoard));
+    board->layout = NULL;
+    board->slot_pos = NULL;
+    board->file_ids = NULL;
+    board->num_edges = 0;
+    Parser parser = {text, 1, error, error_size, false};
+    parseBoard(&parser, board);
+    if (parser.failed) {
+        LoadedBoard_Delete(board);
+        return NULL;
+    }
+    board->max_degree = 0;
+    for (int i = 0; i < board->layout->num_slots; ++i) {
+        int degree = 0;
+        for (
+            const SlotNode *node = board->layout->adj[i]; node;
+            node = node->next
+        ) {
+            ++degree;
+        }
+        if (degree > board->max_degree) {
+            board->max_degree = degree;
+        }
+    }
+    board->num_components = countComponents(board->layout);
+    if (board->layout->num_slots >= LOADED_BOARD_RELABEL_SLOTS) {
+        relabel(board);
+    }
+    return board;
+}
+
+void LoadedBoard_Delete(LoadedBoard *board) {
+    /* Delete the games on `board` first, since they share its edges. */
+    if (board->layout) {
+        GameBoard_Delete(board->layout);
+    }
+    free(board->slot_pos);
+    free(board->file_ids);
+    free(board);
+}
+
+void LoadedBoard_InitDisplayable(
+    const LoadedBoard *board, DisplayableBoard *out
+) {
+    /* Start a new game on `board`; delete `out->board` when done. */
+    out->board = GameBoard_NewSharing(board->layout);
+    out->x_len = board->x_len;
+    out->y_len = board->y_len;
+    out->slot_pos = board->slot_pos;
+}
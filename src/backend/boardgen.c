@@ -0,0 +1,112 @@
+#include "lunar_game.h"
+
+// Synthetic boards, much larger than the preset ones, for measuring
+// how the backend scales with the number of slots and their degree.
+
+typedef struct EdgeList {
+    int *data;
+    int len;
+    int capacity;
+} EdgeList;
+
+static void addEdge(EdgeList *list, int id1, int id2) {
+    if (list->len + 2 >= list->capacity) {
+        list->capacity = list->capacity * 2 + 16;
+        list->data = (int *) realloc(list->data, list->capacity * sizeof(int));
+    }
+    list->data[list->len++] = id1;
+    list->data[list->len++] = id2;
+}
+
+static void grid(EdgeList *list, int width, int height, bool wrap) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const int id = y * width + x;
+            // Wrapping around a side of 2 or less would repeat edges
+            if (x + 1 < width || (wrap && width > 2)) {
+                addEdge(list, id, y * width + (x + 1) % width);
+            }
+            if (y + 1 < height || (wrap && height > 2)) {
+                addEdge(list, id, (y + 1) % height * width + x);
+            }
+        }
+    }
+}
+
+static void planar(EdgeList *list, int width, int height, Random *rng) {
+    /*
+     * A grid where every cell gets one of its diagonals at random, so
+     * that it is cut into triangles, and then a quarter of the edges
+     * are left out at random.
+     */
+    EdgeList all = {NULL, 0, 0};
+    grid(&all, width, height, false);
+    for (int y = 0; y + 1 < height; ++y) {
+        for (int x = 0; x + 1 < width; ++x) {
+            const int id = y * width + x;
+            if (Random_Below(rng, 2)) {
+                addEdge(&all, id, id + width + 1);
+            }
+            else {
+                addEdge(&all, id + 1, id + width);
+            }
+        }
+    }
+    for (int i = 0; i < all.len; i += 2) {
+        if (Random_Below(rng, 4)) {
+            addEdge(list, all.data[i], all.data[i + 1]);
+        }
+    }
+    free(all.data);
+}
+
+static void cliques(EdgeList *list, int size, int count) {
+    /*
+     * `count` groups of `size` slots in a row. Every group is a clique,
+     * and every slot is also adjacent to all the slots of the next
+     * group. Filled with one phase per group, consecutive groups being
+     * consecutive phases, this has the most lunar cycle paths.
+     */
+    for (int g = 0; g < count; ++g) {
+        for (int i = 0; i < size; ++i) {
+            const int id = g * size + i;
+            for (int j = i + 1; j < size; ++j) {
+                addEdge(list, id, g * size + j);
+            }
+            for (int j = 0; g + 1 < count && j < size; ++j) {
+                addEdge(list, id, (g + 1) * size + j);
+            }
+        }
+    }
+}
+
+int *BoardGen_Edges(
+    BoardShape shape,
+    int width,  /* Or size of a group for BS_CLIQUES */
+    int height,  /* Or number of groups for BS_CLIQUES */
+    Random *rng,  /* Only used by BS_PLANAR */
+    int *out_num_slots
+) {
+    /*
+     * Return the edges of a board of `shape` in the format that
+     * `GameBoard_FromEdges` takes; the caller must free them.
+     */
+    EdgeList list = {NULL, 0, 0};
+    switch (shape) {
+    case BS_GRID:
+    case BS_TORUS:
+        grid(&list, width, height, shape == BS_TORUS);
+        break;
+    case BS_PLANAR:
+        planar(&list, width, height, rng);
+        break;
+    case BS_CLIQUES:
+        cliques(&list, width, height);
+        break;
+    default:
+        break;
+    }
+    addEdge(&list, -1, -1);
+    *out_num_slots = width * height;
+    return list.data;
+}
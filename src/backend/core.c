@@ -1,8 +1,13 @@
 /* Core game logic and algorithm. */
 
 #include <assert.h>
+#include <string.h>
 #include "lunar_game.h"
 
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
 void SlotNode_DeleteChain(SlotNode *node) {
     while (node != NULL) {
         SlotNode *next = node->next;
@@ -26,6 +31,7 @@ void SlotNode_ChainPopFront(SlotNode **head) {
 }
 
 void SlotNode_ChainRemove(SlotNode **head, int slot_id) {
+    /* Remove the first node of `slot_id`, if any. */
     for (SlotNode *prev = NULL, *cur = *head; cur; cur = cur->next) {
         if (cur->slot_id == slot_id) {
             if (prev == NULL) {  // `cur` is head
@@ -35,6 +41,7 @@ void SlotNode_ChainRemove(SlotNode **head, int slot_id) {
                 prev->next = cur->next;
                 free(cur);
             }
+            return;
         }
         prev = cur;
     }
@@ -88,24 +95,107 @@ GameBoard *GameBoard_New(int num_slots) {
         g->adj[i] = NULL;
         SlotData_Init(&g->slots[i]);
     }
+    g->owns_adj = true;
     g->black_stars = g->white_stars = 0;
+    g->claimed[P_WHITE] = g->claimed[P_BLACK] = 0;
     g->perks = 0;
+    g->view = NULL;
+    return g;
+}
+
+GameBoard *GameBoard_NewSharing(const GameBoard *layout) {
+    /*
+     * Return an empty board with the slots and edges of `layout`, which
+     * must not get any more edges and must be deleted after this one.
+     * Many games on the same board can share one `adj` that way.
+     */
+    GameBoard *g = (GameBoard *) malloc(sizeof(GameBoard));
+    g->num_slots = layout->num_slots;
+    g->slots = (SlotData *) malloc(g->num_slots * sizeof(SlotData));
+    for (int i = 0; i < g->num_slots; ++i) {
+        SlotData_Init(&g->slots[i]);
+    }
+    g->adj = layout->adj;
+    g->owns_adj = false;
+    g->black_stars = g->white_stars = 0;
+    g->claimed[P_WHITE] = g->claimed[P_BLACK] = 0;
+    g->perks = 0;
+    g->view = NULL;
     return g;
 }
 
 void GameBoard_Delete(GameBoard *board) {
     for (int i = 0; i < board->num_slots; ++i) {
-        SlotNode_DeleteChain(board->adj[i]);
+        if (board->owns_adj) {
+            SlotNode_DeleteChain(board->adj[i]);
+        }
         SlotData_Deinit(&board->slots[i]);
     }
     free(board->slots);
-    free(board->adj);
+    if (board->owns_adj) {
+        free(board->adj);
+    }
+    free(board->view);
     free(board);
 }
 
 void GameBoard_AddEdge(GameBoard *board, int id1, int id2) {
     SlotNode_ChainPrepend(&board->adj[id2], id1);
     SlotNode_ChainPrepend(&board->adj[id1], id2);
+    // The adjacency part of the view is out of date now
+    free(board->view);
+    board->view = NULL;
+}
+
+static void syncViewStates(GameBoard *board) {
+    BoardView *view = board->view;
+    view->white_stars = board->white_stars;
+    view->black_stars = board->black_stars;
+    view->perks = board->perks;
+}
+
+BoardView *GameBoard_View(GameBoard *board) {
+    if (board->view) {
+        return board->view;
+    }
+    const int n = board->num_slots;
+    int adj_len = 0;
+    for (int i = 0; i < n; ++i) {
+        for (const SlotNode *node = board->adj[i]; node; node = node->next) {
+            ++adj_len;
+        }
+    }
+    // Lay out the arrays after the header, 32-bit ones first so that
+    // they stay aligned
+    const size_t size = sizeof(BoardView)
+        + sizeof(int32_t) * (n + 1 + adj_len)
+        + sizeof(int8_t) * 2 * n;
+    BoardView *view = (BoardView *) malloc(size);
+    view->adj_start = (int32_t *) (view + 1);
+    view->adj = view->adj_start + n + 1;
+    view->phases = (int8_t *) (view->adj + adj_len);
+    view->owners = view->phases + n;
+    view->num_slots = n;
+    int pos = 0;
+    for (int i = 0; i < n; ++i) {
+        view->adj_start[i] = pos;
+        for (const SlotNode *node = board->adj[i]; node; node = node->next) {
+            view->adj[pos++] = node->slot_id;
+        }
+        view->phases[i] = (int8_t) board->slots[i].phase;
+        view->owners[i] = (int8_t) board->slots[i].owner;
+    }
+    view->adj_start[n] = pos;
+    board->view = view;
+    syncViewStates(board);
+    return view;
+}
+
+void GameBoard_AddPerks(GameBoard *board, int perks) {
+    board->perks |= perks;
+    if (board->view) {
+        syncViewStates(board);
+    }
 }
 
 GameBoard *GameBoard_FromEdges(int num_slots, const int *edges) {
@@ -118,6 +208,20 @@ GameBoard *GameBoard_FromEdges(int num_slots, const int *edges) {
     return g;
 }
 
+void GameBoard_SetOwner(GameBoard *board, int slot_id, Player owner) {
+    Player *old = &board->slots[slot_id].owner;
+    if (*old != P_NULL) {
+        --board->claimed[*old];
+    }
+    if (owner != P_NULL) {
+        ++board->claimed[owner];
+    }
+    *old = owner;
+    if (board->view) {
+        board->view->owners[slot_id] = (int8_t) owner;
+    }
+}
+
 Pattern *Pattern_New(void) {
     return (Pattern *) malloc(sizeof(Pattern));
 }
@@ -167,6 +271,9 @@ static void findLunarCycle(
 ) {
     const int cur_slot = stack->slot_id;
     SlotData *data = &board->slots[cur_slot];
+#ifdef LUNAR_TRACE
+    ++Trace_core.lc_steps;
+#endif
 #ifndef NDEBUG
     MoonPhase next_phase = (MoonPhase) (
         (data->phase + (forward ? 1 : -1) + MoonPhase_NumPhases)
@@ -211,6 +318,33 @@ static void findLunarCycle(
     }
 }
 
+static void reverseSlotsChain(SlotsNode **head) {
+    SlotsNode *reversed = NULL;
+    while (*head) {
+        SlotsNode *next = (*head)->next;
+        (*head)->next = reversed;
+        reversed = *head;
+        *head = next;
+    }
+    *head = reversed;
+}
+
+static SlotNode *combinePaths(
+    const SlotNode *backward, const SlotNode *forward
+) {
+    /*
+     * Return a new chain of `backward` followed by reversed `forward`
+     * without its first slot, which is the origin in both of them.
+     */
+    SlotNode *tail;
+    SlotNode *head = SlotNode_DuplicateChain(backward, &tail);
+    SlotNode *rev_forward = SlotNode_NewReversedChain(forward);
+    assert(rev_forward && "`forward` should have at least 1 slot in it");
+    SlotNode_ChainPopFront(&rev_forward);
+    tail->next = rev_forward;
+    return head;
+}
+
 static Hash bitsetHashWrapper(void *bs, void *meta) {
     return BitSet_Hash((BitSet *) bs);
 }
@@ -219,14 +353,31 @@ static bool bitsetEqWrapper(void *bs1, void *bs2, void *meta) {
     return BitSet_Equal((BitSet *) bs1, (BitSet *) bs2);
 }
 
-PatternNode *GameBoard_PutCard(
-    GameBoard *board, int slot_id, MoonPhase phase, Player player
+static void claimSlot(
+    GameBoard *board, int slot_id, Player player, SlotNode **changed
+) {
+    /* Give the slot to `player`, noting it in `changed` if it wasn't. */
+    if (board->slots[slot_id].owner == player) {
+        return;
+    }
+    GameBoard_SetOwner(board, slot_id, player);
+    if (changed) {
+        SlotNode_ChainPrepend(changed, slot_id);
+    }
+}
+
+static PatternNode *putCard(
+    GameBoard *board, int slot_id, MoonPhase phase, Player player,
+    SlotNode **changed  /* Slots whose owner changed; may be NULL */
 ) {
     SlotData *data = &board->slots[slot_id];
     assert(data->phase == MP_NULL);
     assert(phase != MP_NULL);
     assert(player != P_NULL);
     data->phase = phase;
+#ifdef LUNAR_TRACE
+    ++Trace_core.put_cards;
+#endif
     // Check for patterns
     PatternNode *patterns = NULL;
     int score = 0;
@@ -250,14 +401,14 @@ PatternNode *GameBoard_PutCard(
         case 0:
             pattern = Pattern_New();
             pattern->kind = PK_PHASE_PAIR;
-            ++score;
+            pattern->score = 1;
             break;
         // Check Full Moon
         case MoonPhase_NumPhases / 2:
         case -MoonPhase_NumPhases / 2:
             pattern = Pattern_New();
             pattern->kind = PK_FULL_MOON;
-            score += always_one_point ? 1 : full_moon_points;
+            pattern->score = always_one_point ? 1 : full_moon_points;
             break;
         // Add data to Lunar Cycle graph
         case 1:
@@ -276,11 +427,12 @@ PatternNode *GameBoard_PutCard(
         }
         if (pattern) {
             // Phase Pair or Full Moon detected
+            score += pattern->score;
             pattern->other_id = other_id;
             PatternNode_ChainPrepend(&patterns, pattern);
-            data->owner = player;
+            claimSlot(board, slot_id, player, changed);
             if (can_steal || other_data->owner == P_NULL) {
-                other_data->owner = player;
+                claimSlot(board, other_id, player, changed);
             }
         }
     }
@@ -295,77 +447,77 @@ PatternNode *GameBoard_PutCard(
         forward && backward
         && "findLunarCycle always gives at least 1 path"
     );
-    // Combine lunar cycle paths to form candidates
-    SlotsNode *candidates = NULL;
-    for (SlotsNode *i = forward; i; i = i->next) {
-        for (SlotsNode *j = backward; j; j = j->next) {
-            // Candidate path = j + reversed(i)[1:]
-            SlotNode *j_tail;
-            SlotNode *head = SlotNode_DuplicateChain(j->slots, &j_tail);
-            SlotNode *rev_i_head = SlotNode_NewReversedChain(i->slots);
-            assert(rev_i_head && "`i` should have at least 1 slot in it");
-            // The origin vertex is present in both the forward path
-            // and the backward path. Remove one of them.
-            SlotNode_ChainPopFront(&rev_i_head);
-            j_tail->next = rev_i_head;
-            SlotsNode_ChainPrepend(&candidates, head);
-        }
-    }
-    SlotsNode_DeleteChain(forward);
-    SlotsNode_DeleteChain(backward);
-    // Validate lunar cycle candidates
+    // Combine lunar cycle paths to form candidates and validate them.
+    // There can be as many candidates as forward paths times backward
+    // paths, so each one is checked right away. Going through both
+    // lists backwards keeps the order patterns have always come in.
     // Check for:
     // 1. repeated vertices
     // 2. repeated patterns (two candidates with the same set of
     // vertices)
     // Delete/Transfer ownership of candidate lists as we go
-    SlotsNode *c = candidates;
+    reverseSlotsChain(&forward);
+    reverseSlotsChain(&backward);
     HashMap *cycles_seen = HashMap_New(
         bitsetHashWrapper, bitsetEqWrapper, NULL
     );
-    while (c) {
-        BitSet *bs = BitSet_New(board->num_slots);
-        BitSet_Zero(bs);
-        SlotNode *prev = NULL;
-        int length = 0;
-        for (SlotNode *i = c->slots; i; i = i->next) {
-            if (BitSet_Get(bs, i->slot_id)) {
-                SlotNode_DeleteChain(i);
-                assert(prev && "shouldn't have a duplicate on first vertex");
-                prev->next = NULL;
-                break;
+    for (SlotsNode *fw = forward; fw; fw = fw->next) {
+        for (SlotsNode *bw = backward; bw; bw = bw->next) {
+            SlotNode *candidate = combinePaths(bw->slots, fw->slots);
+            BitSet *bs = BitSet_New(board->num_slots);
+            BitSet_Zero(bs);
+            SlotNode *prev = NULL;
+            int length = 0;
+            for (SlotNode *i = candidate; i; i = i->next) {
+                if (BitSet_Get(bs, i->slot_id)) {
+                    SlotNode_DeleteChain(i);
+                    assert(
+                        prev && "shouldn't have a duplicate on first vertex"
+                    );
+                    prev->next = NULL;
+                    break;
+                }
+                BitSet_Set(bs, i->slot_id);
+                prev = i;
+                ++length;
             }
-            BitSet_Set(bs, i->slot_id);
-            prev = i;
-            ++length;
-        }
-        if (
-            length >= MIN_LUNAR_CYCLE_LEN
-            && !HashMap_Has(cycles_seen, (void *) bs)
-        ) {
-            // We've found a lunar cycle!
-            HashMap_Insert(cycles_seen, (void *) bs, NULL);
-            score += always_one_point ? 1 : length + lunar_cycle_bonus;
-            Pattern *new_pattern = Pattern_New();
-            new_pattern->kind = PK_LUNAR_CYCLE;
-            new_pattern->list = c->slots;
-            PatternNode_ChainPrepend(&patterns, new_pattern);
-            // Change owner of slots on the cycle
-            for (SlotNode *i = c->slots; i; i = i->next) {
-                Player *owner = &board->slots[i->slot_id].owner;
-                if (can_steal || (*owner == P_NULL)) {
-                    *owner = player;
+#ifdef LUNAR_TRACE
+            ++Trace_core.lc_paths;
+            if (length > Trace_core.lc_max_len) {
+                Trace_core.lc_max_len = length;
+            }
+#endif
+            if (
+                length >= MIN_LUNAR_CYCLE_LEN
+                && !HashMap_Has(cycles_seen, (void *) bs)
+            ) {
+                // We've found a lunar cycle!
+                HashMap_Insert(cycles_seen, (void *) bs, NULL);
+                Pattern *new_pattern = Pattern_New();
+                new_pattern->kind = PK_LUNAR_CYCLE;
+                new_pattern->score =
+                    always_one_point ? 1 : length + lunar_cycle_bonus;
+                score += new_pattern->score;
+                new_pattern->list = candidate;
+                PatternNode_ChainPrepend(&patterns, new_pattern);
+                // Change owner of slots on the cycle
+                for (SlotNode *i = candidate; i; i = i->next) {
+                    if (
+                        can_steal
+                        || board->slots[i->slot_id].owner == P_NULL
+                    ) {
+                        claimSlot(board, i->slot_id, player, changed);
+                    }
                 }
             }
+            else {
+                BitSet_Delete(bs);
+                SlotNode_DeleteChain(candidate);
+            }
         }
-        else {
-            BitSet_Delete(bs);
-            SlotNode_DeleteChain(c->slots);
-        }
-        SlotsNode *next_c = c->next;
-        free(c);
-        c = next_c;
     }
+    SlotsNode_DeleteChain(forward);
+    SlotsNode_DeleteChain(backward);
     HashMap_ITER_ENTRIES(cycles_seen, pair)
         BitSet_Delete((BitSet *) pair->key);
     HashMap_ITER_END
@@ -375,15 +527,95 @@ PatternNode *GameBoard_PutCard(
             // PERK_SAGITTARIUS is single-shot
             board->perks &= ~PERK_SAGITTARIUS;
             score *= 3;
+            for (PatternNode *node = patterns; node; node = node->next) {
+                node->pattern->score *= 3;
+            }
         }
         board->white_stars += score;
     }
     else {
         board->black_stars += score;
     }
+    if (board->view) {
+        board->view->phases[slot_id] = (int8_t) phase;
+        syncViewStates(board);
+    }
     return patterns;
 }
 
+PatternNode *GameBoard_PutCard(
+    GameBoard *board, int slot_id, MoonPhase phase, Player player
+) {
+    return putCard(board, slot_id, phase, player, NULL);
+}
+
+static void flatPush(int *out, int capacity, int *len, int value) {
+    if (*len < capacity) {
+        out[*len] = value;
+    }
+    ++*len;
+}
+
+int GameBoard_PutCardFlat(
+    GameBoard *board, int slot_id, MoonPhase phase, Player player,
+    int *out, int capacity
+) {
+    /*
+     * Same as `GameBoard_PutCard`, but instead of returning a list,
+     * write the patterns into `out`, which has room for `capacity`
+     * integers, in this layout:
+     * - Number of patterns, followed by this for every pattern (in the
+     *   same order as the list `GameBoard_PutCard` gives):
+     *   kind, score, number of slots N, N slot ids
+     *   (Phase Pairs and Full Moons list `slot_id` and the other slot;
+     *   Lunar Cycles list their slots in order.)
+     * - Number of slots whose owner changed, followed by their ids.
+     * Return the number of integers the whole result takes. If that's
+     * greater than `capacity`, the result was cut off at `capacity`
+     * (the card was placed nevertheless).
+     */
+    SlotNode *changed = NULL;
+    PatternNode *patterns =
+        putCard(board, slot_id, phase, player, &changed);
+    int len = 0;
+    int num_patterns = 0;
+    for (PatternNode *node = patterns; node; node = node->next) {
+        ++num_patterns;
+    }
+    flatPush(out, capacity, &len, num_patterns);
+    for (PatternNode *node = patterns; node; node = node->next) {
+        const Pattern *pattern = node->pattern;
+        flatPush(out, capacity, &len, (int) pattern->kind);
+        flatPush(out, capacity, &len, pattern->score);
+        if (pattern->kind == PK_LUNAR_CYCLE) {
+            const int length_at = len;
+            flatPush(out, capacity, &len, 0);
+            for (SlotNode *i = pattern->list; i; i = i->next) {
+                flatPush(out, capacity, &len, i->slot_id);
+            }
+            if (length_at < capacity) {
+                out[length_at] = len - length_at - 1;
+            }
+        }
+        else {
+            flatPush(out, capacity, &len, 2);
+            flatPush(out, capacity, &len, slot_id);
+            flatPush(out, capacity, &len, pattern->other_id);
+        }
+    }
+    PatternNode_DeleteChain(patterns);
+    int num_changed = 0;
+    for (SlotNode *i = changed; i; i = i->next) {
+        ++num_changed;
+    }
+    flatPush(out, capacity, &len, num_changed);
+    for (SlotNode *i = changed; i; i = i->next) {
+        flatPush(out, capacity, &len, i->slot_id);
+    }
+    SlotNode_DeleteChain(changed);
+    return len;
+}
+
 void GameBoard_DestroyCard(GameBoard *board, int slot_id) {
     SlotData *data = &board->slots[slot_id];
     for (SlotNode *n = data->lc_predecessors; n; n = n->next) {
@@ -394,6 +626,230 @@ void GameBoard_DestroyCard(GameBoard *board, int slot_id) {
             &board->slots[n->slot_id].lc_predecessors, slot_id
         );
     }
+    GameBoard_SetOwner(board, slot_id, P_NULL);
     SlotData_Deinit(data);
     SlotData_Init(data);
+    if (board->view) {
+        board->view->phases[slot_id] = (int8_t) MP_NULL;
+    }
+}
+
+static void chainRemoveAll(SlotNode **head, const BitSet *slots) {
+    /* Remove every node whose slot is in `slots`. */
+    while (*head) {
+        SlotNode *node = *head;
+        if (BitSet_Get(slots, node->slot_id)) {
+            *head = node->next;
+            free(node);
+        }
+        else {
+            head = &node->next;
+        }
+    }
+}
+
+void GameBoard_DestroyCards(GameBoard *board, const BitSet *slots) {
+    /*
+     * Same as calling `GameBoard_DestroyCard` on every slot in `slots`,
+     * but each surviving neighbor has its Lunar Cycle lists filtered
+     * only once, however many of its neighbors go away.
+     */
+    BitSet *visited = BitSet_New(board->num_slots);
+    BitSet_Zero(visited);
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (!BitSet_Get(slots, i)) {
+            continue;
+        }
+        const SlotData *data = &board->slots[i];
+        const SlotNode *lists[2] = {
+            data->lc_predecessors, data->lc_successors
+        };
+        for (int k = 0; k < 2; ++k) {
+            for (const SlotNode *n = lists[k]; n; n = n->next) {
+                const int neighbor = n->slot_id;
+                if (
+                    BitSet_Get(slots, neighbor)
+                    || BitSet_Get(visited, neighbor)
+                ) {
+                    continue;
+                }
+                BitSet_Set(visited, neighbor);
+                SlotData *nd = &board->slots[neighbor];
+                chainRemoveAll(&nd->lc_predecessors, slots);
+                chainRemoveAll(&nd->lc_successors, slots);
+            }
+        }
+    }
+    BitSet_Delete(visited);
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (!BitSet_Get(slots, i)) {
+            continue;
+        }
+        GameBoard_SetOwner(board, i, P_NULL);
+        SlotData_Deinit(&board->slots[i]);
+        SlotData_Init(&board->slots[i]);
+        if (board->view) {
+            board->view->phases[i] = (int8_t) MP_NULL;
+        }
+    }
+}
+
+void GameBoard_SetOwners(GameBoard *board, const BitSet *slots, Player owner) {
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (BitSet_Get(slots, i)) {
+            GameBoard_SetOwner(board, i, owner);
+        }
+    }
+}
+
+#ifdef __wasm_simd128__
+
+uint8_t GameBoard_RelatedPhases(const GameBoard *board, int slot_id) {
+    /*
+     * Return the phases that would form a Phase Pair or a Full Moon
+     * Pair, or be linked into the Lunar Cycle graph, if placed on the
+     * empty slot `slot_id`, as bit `p` for phase `p`. A phase whose
+     * bit is clear can't change the board's stars or owners.
+     */
+    // Lane `p` of `hist` counts the neighbors of phase `p`; the
+    // phases it relates to are rotations of that. Lanes are 16 bits
+    // wide since a loaded board may give a slot hundreds of neighbors.
+    const v128_t lanes = wasm_i16x8_make(0, 1, 2, 3, 4, 5, 6, 7);
+    v128_t hist = wasm_i16x8_splat(0);
+    for (const SlotNode *n = board->adj[slot_id]; n; n = n->next) {
+        // No lane compares equal to MP_NULL
+        const int16_t phase = (int16_t) board->slots[n->slot_id].phase;
+        hist = wasm_i16x8_sub(
+            hist, wasm_i16x8_eq(lanes, wasm_i16x8_splat(phase))
+        );
+    }
+    const v128_t opposite =
+        wasm_i16x8_shuffle(hist, hist, 4, 5, 6, 7, 0, 1, 2, 3);
+    const v128_t previous =
+        wasm_i16x8_shuffle(hist, hist, 7, 0, 1, 2, 3, 4, 5, 6);
+    const v128_t next =
+        wasm_i16x8_shuffle(hist, hist, 1, 2, 3, 4, 5, 6, 7, 0);
+    const v128_t any = wasm_v128_or(
+        wasm_v128_or(hist, opposite), wasm_v128_or(previous, next)
+    );
+    return (uint8_t) wasm_i16x8_bitmask(
+        wasm_i16x8_ne(any, wasm_i16x8_splat(0))
+    );
+}
+
+#else
+
+uint8_t GameBoard_RelatedPhases(const GameBoard *board, int slot_id) {
+    /* See the SIMD version above. */
+    bool present[MoonPhase_NumPhases] = {false};
+    for (const SlotNode *n = board->adj[slot_id]; n; n = n->next) {
+        const MoonPhase phase = board->slots[n->slot_id].phase;
+        if (phase != MP_NULL) {
+            present[phase] = true;
+        }
+    }
+    const int half = MoonPhase_NumPhases / 2;
+    uint8_t related = 0;
+    for (int p = 0; p < MoonPhase_NumPhases; ++p) {
+        const int opposite = (p + half) % MoonPhase_NumPhases;
+        const int previous =
+            (p + MoonPhase_NumPhases - 1) % MoonPhase_NumPhases;
+        const int next = (p + 1) % MoonPhase_NumPhases;
+        if (
+            present[p] || present[opposite]
+            || present[previous] || present[next]
+        ) {
+            related |= 1u << p;
+        }
+    }
+    return related;
+}
+
+#endif
+
+#if MIN_LUNAR_CYCLE_LEN < 3
+#error "GameBoard_CardOutcome assumes that 2 slots are no Lunar Cycle"
+#endif
+
+bool GameBoard_CardOutcome(
+    const GameBoard *board, int slot_id, MoonPhase phase, Player player,
+    CardOutcome *out
+) {
+    /*
+     * Work out what `GameBoard_PutCard` would leave in `out` without
+     * changing the board, if the card can't be part of a Lunar Cycle.
+     * Otherwise return false, and the move has to be played to tell.
+     */
+    const MoonPhase previous =
+        (MoonPhase) ((phase + MoonPhase_NumPhases - 1) % MoonPhase_NumPhases);
+    const MoonPhase next = (MoonPhase) ((phase + 1) % MoonPhase_NumPhases);
+    const MoonPhase opposite =
+        (MoonPhase) ((phase + MoonPhase_NumPhases / 2) % MoonPhase_NumPhases);
+    const int full_moon_points =
+        (player == P_WHITE && (board->perks & PERK_SUPER_MOON)) ? 4 : 2;
+    const bool always_one_point =
+        (player == P_BLACK && (board->perks & PERK_MOON_AT_APOGEE));
+    const bool can_steal =
+        !(player == P_BLACK && (board->perks & PERK_WINTER_SOLSTICE));
+    bool has_previous = false, has_next = false;
+    int score = 0;
+    out->claimed[P_WHITE] = board->claimed[P_WHITE];
+    out->claimed[P_BLACK] = board->claimed[P_BLACK];
+    for (const SlotNode *n = board->adj[slot_id]; n; n = n->next) {
+        const SlotData *other = &board->slots[n->slot_id];
+        if (other->phase == previous) {
+            // A path of 3 slots through this one is a Lunar Cycle
+            if (has_next || other->lc_predecessors) {
+                return false;
+            }
+            has_previous = true;
+            continue;
+        }
+        if (other->phase == next) {
+            if (has_previous || other->lc_successors) {
+                return false;
+            }
+            has_next = true;
+            continue;
+        }
+        if (other->phase == phase) {
+            score += 1;
+        }
+        else if (other->phase == opposite) {
+            score += always_one_point ? 1 : full_moon_points;
+        }
+        else {
+            continue;
+        }
+        if (
+            other->owner != player
+            && (can_steal || other->owner == P_NULL)
+        ) {
+            if (other->owner != P_NULL) {
+                --out->claimed[other->owner];
+            }
+            ++out->claimed[player];
+        }
+    }
+    const Player owner = board->slots[slot_id].owner;
+    if (score > 0 && owner != player) {
+        if (owner != P_NULL) {
+            --out->claimed[owner];
+        }
+        ++out->claimed[player];
+    }
+    out->perks = board->perks;
+    out->white_stars = board->white_stars;
+    out->black_stars = board->black_stars;
+    if (player == P_WHITE) {
+        if ((board->perks & PERK_SAGITTARIUS) && score > 0) {
+            out->perks &= ~PERK_SAGITTARIUS;
+            score *= 3;
+        }
+        out->white_stars += score;
+    }
+    else {
+        out->black_stars += score;
+    }
+    return true;
 }
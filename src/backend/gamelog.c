@@ -0,0 +1,168 @@
+#include "lunar_game.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// The move log of a game, which also owns the game's random number
+// generator so that replaying the log makes the same random choices.
+
+static const char *const event_names[GameEventKind_NumKinds] = {
+    "draw", "deal", "play", "ai", "random", "wildcard", "end",
+};
+
+// Number of `args` each kind of event has
+static const int event_num_args[GameEventKind_NumKinds] = {
+    3, 3, 3, 3, 2, 3, 4,
+};
+
+GameLog *GameLog_New(int board_id, uint64_t seed, int cards_in_a_hand) {
+    GameLog *log = (GameLog *) malloc(sizeof(GameLog));
+    log->board_id = board_id;
+    log->seed = seed;
+    log->cards_in_a_hand = cards_in_a_hand;
+    Random_Seed(&log->rng, seed);
+    log->events = NULL;
+    log->num_events = 0;
+    log->capacity = 0;
+    return log;
+}
+
+void GameLog_Delete(GameLog *log) {
+    free(log->events);
+    free(log);
+}
+
+static void addEvent(
+    GameLog *log, GameEventKind kind, int a, int b, int c, int d
+) {
+    if (log->num_events == log->capacity) {
+        log->capacity = log->capacity * 2 + 32;
+        log->events = (GameEvent *)
+            realloc(log->events, log->capacity * sizeof(GameEvent));
+    }
+    GameEvent *event = &log->events[log->num_events++];
+    event->kind = kind;
+    event->args[0] = a;
+    event->args[1] = b;
+    event->args[2] = c;
+    event->args[3] = d;
+}
+
+MoonPhase GameLog_Draw(GameLog *log, Player player, int card) {
+    const MoonPhase phase =
+        (MoonPhase) Random_Below(&log->rng, MoonPhase_NumPhases);
+    addEvent(log, GE_DRAW, player, card, phase, 0);
+    return phase;
+}
+
+void GameLog_Deal(GameLog *log, Player player, int card, MoonPhase phase) {
+    addEvent(log, GE_DEAL, player, card, phase, 0);
+}
+
+void GameLog_Play(GameLog *log, Player player, int card, int slot_id) {
+    addEvent(log, GE_PLAY, player, card, slot_id, 0);
+}
+
+uint32_t GameLog_AI(GameLog *log, Player player, int depth, int top_k) {
+    /* Return the seed the AI picks among its `top_k` best moves with. */
+    addEvent(log, GE_AI, player, depth, top_k, 0);
+    return Random_Next(&log->rng);
+}
+
+int GameLog_Below(GameLog *log, int bound) {
+    const int value = Random_Below(&log->rng, bound);
+    addEvent(log, GE_RANDOM, bound, value, 0, 0);
+    return value;
+}
+
+uint32_t GameLog_Wildcard(
+    GameLog *log, Player player, WildcardKind kind, int target_slot
+) {
+    /* Return the seed for the `Random` the wildcard is played with. */
+    addEvent(log, GE_WILDCARD, player, kind, target_slot, 0);
+    return Random_Next(&log->rng);
+}
+
+void GameLog_End(GameLog *log, const GameBoard *board) {
+    addEvent(
+        log, GE_END, board->white_stars, board->black_stars,
+        board->claimed[P_WHITE], board->claimed[P_BLACK]
+    );
+}
+
+char *GameLog_ToText(const GameLog *log) {
+    /*
+     * Return the log as text, which the caller must free: a header
+     * line, then one line per event with its name and arguments.
+     */
+    // A line is at most a name and 4 numbers of 11 characters
+    const size_t capacity = 64 + (size_t) log->num_events * 64;
+    char *text = (char *) malloc(capacity);
+    int len = snprintf(
+        text, capacity, "lunar-log %d %d %" PRIu64 " %d\n",
+        GAME_LOG_VERSION, log->board_id, log->seed, log->cards_in_a_hand
+    );
+    for (int i = 0; i < log->num_events; ++i) {
+        const GameEvent *event = &log->events[i];
+        len += snprintf(
+            text + len, capacity - len, "%s", event_names[event->kind]
+        );
+        for (int j = 0; j < event_num_args[event->kind]; ++j) {
+            len += snprintf(
+                text + len, capacity - len, " %d", event->args[j]
+            );
+        }
+        text[len++] = '\n';
+    }
+    text[len] = '\0';
+    return text;
+}
+
+GameLog *GameLog_FromText(const char *text) {
+    /*
+     * Parse what `GameLog_ToText` returns, or return NULL if `text` is
+     * not a game log. The random number generator of the result starts
+     * over from the seed.
+     */
+    int version, board_id, cards_in_a_hand, n;
+    uint64_t seed;
+    if (
+        sscanf(
+            text, "lunar-log %d %d %" SCNu64 " %d%n",
+            &version, &board_id, &seed, &cards_in_a_hand, &n
+        ) != 4
+        || version != GAME_LOG_VERSION
+    ) {
+        return NULL;
+    }
+    GameLog *log = GameLog_New(board_id, seed, cards_in_a_hand);
+    text += n;
+    for (;;) {
+        char name[16];
+        int args[4] = {0, 0, 0, 0};
+        if (sscanf(text, " %15s%n", name, &n) != 1) {
+            return log;
+        }
+        text += n;
+        int kind = 0;
+        while (
+            kind < GameEventKind_NumKinds && strcmp(name, event_names[kind])
+        ) {
+            ++kind;
+        }
+        if (kind == GameEventKind_NumKinds) {
+            GameLog_Delete(log);
+            return NULL;
+        }
+        for (int j = 0; j < event_num_args[kind]; ++j) {
+            if (sscanf(text, " %d%n", &args[j], &n) != 1) {
+                GameLog_Delete(log);
+                return NULL;
+            }
+            text += n;
+        }
+        addEvent(
+            log, (GameEventKind) kind, args[0], args[1], args[2], args[3]
+        );
+    }
+}
@@ -105,3 +105,20 @@ void *HashMap_GetOr(const HashMap *map, void *key, void *default_) {
 bool HashMap_Has(const HashMap *map, void *key) {
     return map_get(map, key) != NULL;
 }
+
+void *HashMap_Remove(HashMap *map, void *key) {
+    /* Return the value `key` had, or NULL if `map` does not have it. */
+    const int index = map->hash(key, map->meta) % map->capacity;
+    for (HashPair **entry = &map->buckets[index]; *entry; ) {
+        HashPair *pair = *entry;
+        if (map->eq(pair->key, key, map->meta)) {
+            void *value = pair->value;
+            *entry = pair->next;
+            free(pair);
+            map->size--;
+            return value;
+        }
+        entry = &pair->next;
+    }
+    return NULL;
+}
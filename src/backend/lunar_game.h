@@ -2,6 +2,7 @@
 #define LUNAR_GAME_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /* hash_map.c */
@@ -34,6 +35,7 @@ void *HashMap_Get(const HashMap *map, void *key);
 void HashMap_Set(HashMap *map, void *key, void *value);
 void *HashMap_GetOr(const HashMap *map, void *key, void *default_);
 bool HashMap_Has(const HashMap *map, void *key);
+void *HashMap_Remove(HashMap *map, void *key);
 
 #define HashMap_ITER_ENTRIES(map, var) \
     for (int i = 0; i < map->capacity; ++i) { \
@@ -57,6 +59,56 @@ void BitSet_Zero(BitSet *bs);
 bool BitSet_Equal(const BitSet *bs1, const BitSet *bs2);
 Hash BitSet_Hash(const BitSet *bs);
 
+/* random.c */
+
+typedef struct Random {
+    uint64_t state;
+} Random;
+
+void Random_Seed(Random *rng, uint64_t seed);
+uint32_t Random_Next(Random *rng);
+int Random_Below(Random *rng, int n);
+
+/* trace.c */
+
+#ifdef LUNAR_TRACE
+// Events in the Chrome Trace Event Format, recorded by builds that
+// define LUNAR_TRACE; see `Trace_ToJSON`. Names must be string
+// literals that need no escaping in JSON.
+
+#define TRACE_MAX_ARGS 8
+
+typedef struct TraceEvent {
+    const char *name;
+    const char *cat;
+    char ph;  // 'X' (span), 'C' (counter) or 'i' (instant)
+    double ts;  // In microseconds, see `Trace_Now`
+    double dur;  // Only for spans
+    int num_args;
+    const char *arg_names[TRACE_MAX_ARGS];
+    double args[TRACE_MAX_ARGS];
+} TraceEvent;
+
+// Counted by core.c whether recording or not; readers take differences
+typedef struct TraceCoreCounters {
+    long put_cards;  // Calls to `GameBoard_PutCard`
+    long lc_steps;  // Steps of the search for lunar cycle paths
+    long lc_paths;  // Lunar cycle candidates checked
+    int lc_max_len;  // Longest path seen; reset by the reader
+} TraceCoreCounters;
+
+extern TraceCoreCounters Trace_core;
+
+void Trace_Start(int max_span_ply);
+void Trace_Stop(void);
+bool Trace_IsRecording(void);
+int Trace_MaxSpanPly(void);
+double Trace_Now(void);
+TraceEvent *Trace_Add(char ph, const char *cat, const char *name, double ts);
+void TraceEvent_AddArg(TraceEvent *event, const char *name, double value);
+char *Trace_ToJSON(void);
+#endif
+
 /* core.c */
 
 typedef enum MoonPhase {
@@ -125,21 +177,53 @@ void SlotData_Deinit(SlotData *data);
 // All matches worth 1 point for black
 #define PERK_MOON_AT_APOGEE 0x40
 
+/*
+ * A flat copy of the board state, for hosts that would rather read
+ * memory directly than call a function for every field (the JavaScript
+ * frontend maps these arrays as typed arrays). All arrays live in the
+ * same allocation as the view itself. Once created by `GameBoard_View`
+ * it is kept up to date by every `GameBoard_*` function that changes
+ * the board, except that adding edges invalidates it.
+ */
+typedef struct BoardView {
+    int32_t num_slots;
+    int32_t white_stars;
+    int32_t black_stars;
+    int32_t perks;
+    int8_t *phases;  // `num_slots` entries; MP_NULL for empty slots
+    int8_t *owners;  // `num_slots` entries; P_NULL for unclaimed slots
+    // Adjacency in compressed sparse row form: neighbors of slot `i`
+    // are `adj[adj_start[i]]` up to (excluding) `adj[adj_start[i + 1]]`
+    int32_t *adj_start;  // `num_slots + 1` entries
+    int32_t *adj;
+} BoardView;
+
 typedef struct GameBoard {
     // Game board
     int num_slots;
     SlotData *slots;
     SlotNode **adj;
+    // If not, `adj` belongs to the board this one was made from by
+    // `GameBoard_NewSharing`, and must outlive it
+    bool owns_adj;
     // Game states
     int white_stars;
     int black_stars;
     int perks;
+    // Evaluation terms that are kept up to date on every change to the
+    // board, so that the AI does not need to scan the slots:
+    int claimed[2];  // Number of slots owned by each `Player`
+    BoardView *view;  // NULL until `GameBoard_View` is called
 } GameBoard;
 
 GameBoard *GameBoard_New(int num_slots);
+GameBoard *GameBoard_NewSharing(const GameBoard *layout);
 void GameBoard_Delete(GameBoard *board);
 void GameBoard_AddEdge(GameBoard *board, int id1, int id2);
 GameBoard *GameBoard_FromEdges(int num_slots, const int *edges);
+void GameBoard_SetOwner(GameBoard *board, int slot_id, Player owner);
+void GameBoard_AddPerks(GameBoard *board, int perks);
+BoardView *GameBoard_View(GameBoard *board);
 
 typedef enum PatternKind {
     PK_PHASE_PAIR,
@@ -151,6 +235,7 @@ typedef enum PatternKind {
 
 typedef struct Pattern {
     PatternKind kind;
+    int score;  // Points the pattern earned, with perks applied
     union {
         int other_id;  // PK_PHASE_PAIR, PK_FULL_MOON
         SlotNode *list;  // PK_LUNAR_CYCLE
@@ -171,8 +256,63 @@ void PatternNode_DeleteChain(PatternNode *node);
 PatternNode *GameBoard_PutCard(
     GameBoard *board, int slot_id, MoonPhase phase, Player player
 );
+int GameBoard_PutCardFlat(
+    GameBoard *board, int slot_id, MoonPhase phase, Player player,
+    int *out, int capacity
+);
 void GameBoard_DestroyCard(GameBoard *board, int slot_id);
 
+uint8_t GameBoard_RelatedPhases(const GameBoard *board, int slot_id);
+
+// The stars, perks and claimed slots a board would have after a move
+typedef struct CardOutcome {
+    int white_stars;
+    int black_stars;
+    int perks;
+    int claimed[2];
+} CardOutcome;
+
+bool GameBoard_CardOutcome(
+    const GameBoard *board, int slot_id, MoonPhase phase, Player player,
+    CardOutcome *out
+);
+void GameBoard_DestroyCards(GameBoard *board, const BitSet *slots);
+void GameBoard_SetOwners(GameBoard *board, const BitSet *slots, Player owner);
+
+/* wildcards.c */
+
+// Values match the wildcard IDs the frontend stores
+typedef enum WildcardKind {
+    WC_HUNTER_MOON = 0,
+    WC_SUPER_MOON,
+    WC_SCORPIO,
+    WC_LEONIDS_METEOR_SHOWER,
+    WC_WINTER_SOLSTICE,
+    WC_BEAVER_MOON,
+    WC_SAGITTARIUS,
+    WC_GEMINID_METEOR_SHOWER,
+    WC_LONG_NIGHT_MOON,
+    WC_QUADRANTIDS_METEOR_SHOWER,
+    WC_LIGHT_OF_MARS,
+    WC_CAPRICORN,
+    WC_AQUARIUS,
+    WC_LIGHT_OF_VENUS,
+    WC_MOON_AT_APOGEE,
+    WC_WOLF_MOON,
+    // Total number of wildcards
+    WildcardKind_NumKinds,
+} WildcardKind;
+
+bool Wildcard_NeedsTarget(WildcardKind kind);
+bool GameBoard_ApplyWildcard(
+    GameBoard *board, WildcardKind kind, int target_slot, Random *rng,
+    BitSet *out_affected, PatternNode **out_patterns
+);
+int GameBoard_ApplyWildcardFlat(
+    GameBoard *board, WildcardKind kind, int target_slot, Random *rng,
+    int *out, int capacity
+);
+
 /* boards.c */
 
 typedef struct SlotPos {
@@ -209,6 +349,146 @@ typedef struct DisplayableBoard {
 #define DISPLAY_END
 #include "boards_data.inc"
 
+/* boardfile.c */
+
+#define LOADED_BOARD_MAX_SLOTS 1024
+// Loaded boards at least this large get their slots renumbered, see
+// relabel.c
+#define LOADED_BOARD_RELABEL_SLOTS 64
+
+// A board loaded at run time, see `LoadedBoard_Parse`
+typedef struct LoadedBoard {
+    char name[64];
+    // Holds the edges, which every game on the board shares (see
+    // `GameBoard_NewSharing`); no cards are ever put on it
+    GameBoard *layout;
+    int x_len;
+    int y_len;
+    SlotPos *slot_pos;
+    int num_edges;
+    int max_degree;
+    int num_components;  // Parts of the board not linked to each other
+    // The ID each slot has in the file, or NULL if they are the same
+    int *file_ids;
+} LoadedBoard;
+
+LoadedBoard *LoadedBoard_Parse(const char *text, char *error, int error_size);
+void LoadedBoard_Delete(LoadedBoard *board);
+void LoadedBoard_InitDisplayable(
+    const LoadedBoard *board, DisplayableBoard *out
+);
+
+/* boardgen.c */
+
+typedef enum BoardShape {
+    BS_GRID,  // Width x height, each slot adjacent to up to 4 others
+    BS_TORUS,  // Same, but the sides wrap around
+    BS_PLANAR,  // Random planar graph made from a triangulated grid
+    BS_CLIQUES,  // Chain of cliques, see boardgen.c
+    BoardShape_NumShapes,
+} BoardShape;
+
+int *BoardGen_Edges(
+    BoardShape shape, int width, int height, Random *rng, int *out_num_slots
+);
+
+/* relabel.c */
+
+int *Slots_LocalOrder(int num_slots, const int *edges);
+int *Edges_Relabel(const int *edges, const int *new_ids);
+int Edges_Bandwidth(const int *edges, const int *new_ids);
+GameBoard *GameBoard_FromEdgesRelabeled(
+    int num_slots, const int *edges, int *out_new_ids
+);
+
+/* snapshot.c */
+
+#define SNAPSHOT_MAGIC 0x534c4e4cu  // "LNLS" in a little-endian file
+#define SNAPSHOT_VERSION 2
+
+/*
+ * A board position as a flat record: this header, then the phase and
+ * then the owner of every slot (one byte each, padded to a multiple of
+ * 4 bytes), then `num_edges` pairs of 16-bit slot IDs. Records can be
+ * stored back to back (each is `size` bytes, a multiple of 4) and read
+ * in place, e.g. from a memory-mapped file, without any parsing. The
+ * layout is that of a little-endian host.
+ */
+typedef struct BoardSnapshot {
+    uint32_t magic;  // SNAPSHOT_MAGIC
+    uint16_t version;  // SNAPSHOT_VERSION
+    int16_t board_id;  // Up to the writer, or -1 if the edges follow
+    uint32_t size;  // Of the whole record in bytes
+    // A loaded board may have more edges than 16 bits can count
+    uint32_t num_edges;
+    uint16_t num_slots;
+    uint16_t reserved;  // 0
+    int32_t white_stars;
+    int32_t black_stars;
+    int32_t perks;
+    int8_t cells[];
+} BoardSnapshot;
+
+#define BoardSnapshot_Phases(snap) ((snap)->cells)
+#define BoardSnapshot_Owners(snap) ((snap)->cells + (snap)->num_slots)
+
+size_t GameBoard_SnapshotSize(const GameBoard *board, int board_id);
+size_t GameBoard_Snapshot(const GameBoard *board, int board_id, void *out);
+const BoardSnapshot *BoardSnapshot_Check(const void *data, size_t size);
+const uint16_t *BoardSnapshot_Edges(const BoardSnapshot *snap);
+void GameBoard_LoadSnapshot(GameBoard *board, const BoardSnapshot *snap);
+GameBoard *BoardSnapshot_NewBoard(const BoardSnapshot *snap);
+
+/* gamelog.c */
+
+#define GAME_LOG_VERSION 1
+
+// What happened in a game, in order; see gamelog.c for the text form
+typedef enum GameEventKind {
+    GE_DRAW,  // Player, hand index, phase drawn from the log's `rng`
+    GE_DEAL,  // Player, hand index, phase chosen by the host
+    GE_PLAY,  // Player, hand index, slot the card was put on
+    // Player, depth, top_k: the player's next GE_PLAY is the AI's
+    // choice, picked among the best `top_k` moves with a seed drawn
+    // from `rng` (see `Glue_AIMove`)
+    GE_AI,
+    GE_RANDOM,  // Bound, value drawn below it from `rng`
+    GE_WILDCARD,  // Player, kind, target slot; seeded from `rng`
+    GE_END,  // White stars, black stars, white and black claimed slots
+    GameEventKind_NumKinds,
+} GameEventKind;
+
+typedef struct GameEvent {
+    GameEventKind kind;
+    int args[4];
+} GameEvent;
+
+typedef struct GameLog {
+    int board_id;  // Up to the host; the index of a preset board
+    uint64_t seed;
+    int cards_in_a_hand;
+    // Every random choice of the game must come from this, through the
+    // `GameLog_*` functions that log it, so that the log replays
+    Random rng;
+    GameEvent *events;
+    int num_events;
+    int capacity;
+} GameLog;
+
+GameLog *GameLog_New(int board_id, uint64_t seed, int cards_in_a_hand);
+void GameLog_Delete(GameLog *log);
+MoonPhase GameLog_Draw(GameLog *log, Player player, int card);
+void GameLog_Deal(GameLog *log, Player player, int card, MoonPhase phase);
+void GameLog_Play(GameLog *log, Player player, int card, int slot_id);
+uint32_t GameLog_AI(GameLog *log, Player player, int depth, int top_k);
+int GameLog_Below(GameLog *log, int bound);
+uint32_t GameLog_Wildcard(
+    GameLog *log, Player player, WildcardKind kind, int target_slot
+);
+void GameLog_End(GameLog *log, const GameBoard *board);
+char *GameLog_ToText(const GameLog *log);
+GameLog *GameLog_FromText(const char *text);
+
 /* ai.c */
 
 typedef struct AIDecision {
@@ -216,8 +496,106 @@ typedef struct AIDecision {
     int slot_id;
 } AIDecision;
 
+// Default value of `AIOptions.cache_limit` in bytes
+#ifndef AI_DEFAULT_CACHE_LIMIT
+#define AI_DEFAULT_CACHE_LIMIT (4u << 20)
+#endif
+
+// Reported to `AIOptions.on_progress` after each root move is searched
+typedef struct AIProgress {
+    AIDecision best;  // Best root move found so far
+    float score;  // Weight of `best`
+    float score_error;  // Standard error of `score`, see `chance_samples`
+    long nodes;  // Number of search tree nodes visited so far
+    int moves_done;  // Root moves searched so far
+    int moves_total;  // Number of root moves
+} AIProgress;
+
+typedef void (*AIProgressFunc)(const AIProgress *progress, void *userdata);
+
+typedef struct AIOptions {
+    // Upper bound on the memory used by the search cache, in bytes.
+    // When the cache is full, old results get replaced. 0 disables the
+    // cache.
+    size_t cache_limit;
+    // If not NULL, the search is abandoned soon after this becomes
+    // nonzero. The host may set it from another thread or, in the
+    // browser, while the search is taking a break.
+    const volatile int *abort_flag;
+    // If not NULL, called with `progress_userdata` every time a root
+    // move is finished. The host can set `abort_flag` in there to
+    // settle for the best move so far.
+    AIProgressFunc on_progress;
+    void *progress_userdata;
+    // If between 2 and 7, chance nodes (the AI drawing a card) search
+    // only this many draws, one from each of as many groups of
+    // consecutive phases, instead of all 8. That makes scores
+    // estimates; their standard error is reported with them. The
+    // first `exact_chance_layers` layers of chance nodes below the
+    // root are always searched in full. The draws are picked with a
+    // `Random` seeded with `sample_seed`. Chance nodes with 1 ply left
+    // only evaluate the board, so with the default of 1 exact layer
+    // nothing is sampled below depth 7 (below depth 4 with 0).
+    int chance_samples;
+    int exact_chance_layers;
+    uint64_t sample_seed;
+    // If `root_split` > 1, only every `root_split`th root move, starting
+    // from the `root_part`th, is searched, so that that many searches
+    // can share the root moves and the best of their results is the
+    // move `AIMove` would play (ties go to the move `AIMove` tries
+    // first). If `shared_bound` is not NULL, it holds the best score
+    // any of those searches has found so far, and root moves that
+    // can't beat it are cut short. It is read before every root move.
+    int root_split;
+    int root_part;
+    const volatile float *shared_bound;
+} AIOptions;
+
+void AIOptions_Init(AIOptions *options);
+
+typedef struct AIStats {
+    long nodes;  // Number of search tree nodes visited
+    size_t cache_bytes;  // Size of the cache table that was allocated
+    size_t cache_peak_bytes;  // Most bytes of that table ever in use
+    long cache_hits;
+} AIStats;
+
+// A root move with its weight, see `AIRankMoves`
+typedef struct AIRankedMove {
+    AIDecision decision;
+    float score;
+    float error;  // Standard error of `score`, see `chance_samples`
+    bool exact;  // If not, `score` is only an upper bound
+} AIRankedMove;
+
 AIDecision *AIMove(
     const GameBoard *board, MoonPhase *choices, int num_choices, int depth
 );
+AIDecision *AIMoveWithOptions(
+    const GameBoard *board, MoonPhase *choices, int num_choices, int depth,
+    const AIOptions *options, AIStats *out_stats
+);
+AIRankedMove *AIRankMoves(
+    const GameBoard *board, MoonPhase *choices, int num_choices, int depth,
+    int num_exact, const AIOptions *options, int *out_num_moves,
+    AIStats *out_stats
+);
+
+// A search of `AIMoveWithOptions` or `AIRankMoves` that the host runs a
+// slice at a time
+typedef struct AISearch AISearch;
+
+AISearch *AISearch_Begin(
+    const GameBoard *board, const MoonPhase *choices, int num_choices,
+    int depth, const AIOptions *options
+);
+AISearch *AISearch_BeginRanking(
+    const GameBoard *board, const MoonPhase *choices, int num_choices,
+    int depth, int num_exact, const AIOptions *options
+);
+bool AISearch_Step(AISearch *search, long node_budget);
+AIDecision *AISearch_Result(const AISearch *search, AIStats *out_stats);
+AIRankedMove *AISearch_Ranking(const AISearch *search, int *out_num_moves);
+void AISearch_Delete(AISearch *search);
 
 #endif  /* LUNAR_GAME_H */
@@ -0,0 +1,20 @@
+#include "lunar_game.h"
+
+// SplitMix64: small, fast and good enough for shuffling cards. Unlike
+// rand() it gives the same numbers on every platform for a given seed.
+
+void Random_Seed(Random *rng, uint64_t seed) {
+    rng->state = seed;
+}
+
+uint32_t Random_Next(Random *rng) {
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15u);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+    return (uint32_t) ((z ^ (z >> 31)) >> 32);
+}
+
+int Random_Below(Random *rng, int n) {
+    /* Return an integer in [0, n). `n` must be positive. */
+    return (int) (((uint64_t) Random_Next(rng) * (uint64_t) n) >> 32);
+}
@@ -0,0 +1,147 @@
+#include "lunar_game.h"
+
+// Renumbering slots so that neighbors get close IDs. The slot data and
+// bit sets of a board are indexed by slot ID, so that keeps what
+// `GameBoard_PutCard` and the Lunar Cycle search touch close together
+// in memory on large boards.
+
+static int countEdges(const int *edges) {
+    int n = 0;
+    while (edges[2 * n] != -1) {
+        ++n;
+    }
+    return n;
+}
+
+int *Slots_LocalOrder(int num_slots, const int *edges) {
+    /*
+     * Return the new ID of every slot (which the caller must free) in
+     * the Reverse Cuthill-McKee order of the graph given by the
+     * -1-terminated `edges`: a breadth-first order that starts from a
+     * slot of lowest degree in each connected part and visits the
+     * neighbors of a slot from the lowest degree up, reversed.
+     */
+    const int num_edges = countEdges(edges);
+    // The neighbors of slot `i` are `adj[start[i]]` to
+    // `adj[start[i + 1] - 1]`
+    int *start = (int *) calloc(num_slots + 1, sizeof(int));
+    // One more `int` so that a board without edges mallocs something
+    int *adj = (int *) malloc((2 * num_edges + 1) * sizeof(int));
+    for (int i = 0; i < 2 * num_edges; ++i) {
+        ++start[edges[i] + 1];
+    }
+    for (int i = 0; i < num_slots; ++i) {
+        start[i + 1] += start[i];
+    }
+    int *fill = (int *) malloc(num_slots * sizeof(int));
+    for (int i = 0; i < num_slots; ++i) {
+        fill[i] = start[i];
+    }
+    for (int i = 0; i < num_edges; ++i) {
+        adj[fill[edges[2 * i]]++] = edges[2 * i + 1];
+        adj[fill[edges[2 * i + 1]]++] = edges[2 * i];
+    }
+    free(fill);
+    // `order` is the queue of the breadth-first search
+    int *order = (int *) malloc(num_slots * sizeof(int));
+    BitSet *seen = BitSet_New(num_slots);
+    BitSet_Zero(seen);
+    int len = 0;
+    while (len < num_slots) {
+        int root = -1;
+        for (int i = 0; i < num_slots; ++i) {
+            if (
+                !BitSet_Get(seen, i)
+                && (root < 0
+                    || start[i + 1] - start[i] < start[root + 1] - start[root])
+            ) {
+                root = i;
+            }
+        }
+        BitSet_Set(seen, root);
+        order[len++] = root;
+        for (int head = len - 1; head < len; ++head) {
+            const int slot = order[head];
+            const int first = len;
+            for (int j = start[slot]; j < start[slot + 1]; ++j) {
+                if (!BitSet_Get(seen, adj[j])) {
+                    BitSet_Set(seen, adj[j]);
+                    order[len++] = adj[j];
+                }
+            }
+            // Insertion sort of the new ones by degree; stable, so
+            // that ties keep the order of `edges`
+            for (int j = first + 1; j < len; ++j) {
+                const int id = order[j];
+                const int degree = start[id + 1] - start[id];
+                int k = j;
+                for (
+                    ;
+                    k > first
+                    && start[order[k - 1] + 1] - start[order[k - 1]] > degree;
+                    --k
+                ) {
+                    order[k] = order[k - 1];
+                }
+                order[k] = id;
+            }
+        }
+    }
+    int *new_ids = (int *) malloc(num_slots * sizeof(int));
+    for (int i = 0; i < num_slots; ++i) {
+        new_ids[order[i]] = num_slots - 1 - i;
+    }
+    BitSet_Delete(seen);
+    free(order);
+    free(adj);
+    free(start);
+    return new_ids;
+}
+
+int *Edges_Relabel(const int *edges, const int *new_ids) {
+    /* Return a copy of `edges` with slot `i` renamed `new_ids[i]`. */
+    const int num_edges = countEdges(edges);
+    int *res = (int *) malloc((2 * num_edges + 1) * sizeof(int));
+    for (int i = 0; i < 2 * num_edges; ++i) {
+        res[i] = new_ids[edges[i]];
+    }
+    res[2 * num_edges] = -1;
+    return res;
+}
+
+int Edges_Bandwidth(const int *edges, const int *new_ids) {
+    /*
+     * Largest difference between the IDs of two neighbors, with slot
+     * `i` renamed `new_ids[i]` if `new_ids` is not NULL.
+     */
+    int res = 0;
+    for (int i = 0; edges[i] != -1; i += 2) {
+        const int id1 = new_ids ? new_ids[edges[i]] : edges[i];
+        const int id2 = new_ids ? new_ids[edges[i + 1]] : edges[i + 1];
+        const int diff = id1 > id2 ? id1 - id2 : id2 - id1;
+        if (diff > res) {
+            res = diff;
+        }
+    }
+    return res;
+}
+
+GameBoard *GameBoard_FromEdgesRelabeled(
+    int num_slots, const int *edges, int *out_new_ids
+) {
+    /*
+     * `GameBoard_FromEdges` with the slots renumbered by
+     * `Slots_LocalOrder`. Slot `i` of `edges` becomes slot
+     * `out_new_ids[i]` of the board; `out_new_ids` must have room for
+     * `num_slots` IDs.
+     */
+    int *new_ids = Slots_LocalOrder(num_slots, edges);
+    int *relabeled = Edges_Relabel(edges, new_ids);
+    GameBoard *board = GameBoard_FromEdges(num_slots, relabeled);
+    for (int i = 0; i < num_slots; ++i) {
+        out_new_ids[i] = new_ids[i];
+    }
+    free(relabeled);
+    free(new_ids);
+    return board;
+}
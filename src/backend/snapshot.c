@@ -0,0 +1,163 @@
+#include "lunar_game.h"
+#include <string.h>
+
+// Board positions as flat records that can be stored back to back in a
+// file and read in place, see `BoardSnapshot`.
+
+static size_t cellsSize(size_t num_slots) {
+    // Phases and owners, padded so that the edges stay aligned
+    return (2 * num_slots + 3) & ~(size_t) 3;
+}
+
+static size_t recordSize(size_t num_slots, size_t num_edges) {
+    return sizeof(BoardSnapshot) + cellsSize(num_slots)
+        + sizeof(uint16_t) * 2 * num_edges;
+}
+
+static int countEdges(const GameBoard *board) {
+    int n = 0;
+    for (int i = 0; i < board->num_slots; ++i) {
+        for (const SlotNode *node = board->adj[i]; node; node = node->next) {
+            n += node->slot_id > i;
+        }
+    }
+    return n;
+}
+
+size_t GameBoard_SnapshotSize(const GameBoard *board, int board_id) {
+    return recordSize(
+        board->num_slots, board_id < 0 ? countEdges(board) : 0
+    );
+}
+
+size_t GameBoard_Snapshot(const GameBoard *board, int board_id, void *out) {
+    /*
+     * Write the position of `board` to `out`, which must have room for
+     * `GameBoard_SnapshotSize` bytes, and return that size. With a
+     * `board_id` of -1 the edges are written too; otherwise loading the
+     * snapshot takes a board with the same edges.
+     */
+    const int num_edges = board_id < 0 ? countEdges(board) : 0;
+    const size_t size = recordSize(board->num_slots, num_edges);
+    BoardSnapshot *snap = (BoardSnapshot *) out;
+    snap->magic = SNAPSHOT_MAGIC;
+    snap->version = SNAPSHOT_VERSION;
+    snap->board_id = (int16_t) (board_id < 0 ? -1 : board_id);
+    snap->size = (uint32_t) size;
+    snap->num_edges = (uint32_t) num_edges;
+    snap->num_slots = (uint16_t) board->num_slots;
+    snap->reserved = 0;
+    snap->white_stars = board->white_stars;
+    snap->black_stars = board->black_stars;
+    snap->perks = board->perks;
+    int8_t *cells = snap->cells;
+    memset(cells, 0, cellsSize(board->num_slots));
+    for (int i = 0; i < board->num_slots; ++i) {
+        cells[i] = (int8_t) board->slots[i].phase;
+        cells[board->num_slots + i] = (int8_t) board->slots[i].owner;
+    }
+    uint16_t *edges = (uint16_t *) (cells + cellsSize(board->num_slots));
+    for (int i = 0; num_edges && i < board->num_slots; ++i) {
+        for (const SlotNode *node = board->adj[i]; node; node = node->next) {
+            if (node->slot_id > i) {
+                *edges++ = (uint16_t) i;
+                *edges++ = (uint16_t) node->slot_id;
+            }
+        }
+    }
+    return size;
+}
+
+const BoardSnapshot *BoardSnapshot_Check(const void *data, size_t size) {
+    /*
+     * Return `data` as a snapshot if it starts with a valid one of at
+     * most `size` bytes, or NULL. `data` must be 4-byte aligned.
+     */
+    const BoardSnapshot *snap = (const BoardSnapshot *) data;
+    if (
+        size < sizeof(BoardSnapshot)
+        || snap->magic != SNAPSHOT_MAGIC
+        || snap->version != SNAPSHOT_VERSION
+        || snap->size > size
+        // Each edge takes 4 bytes; this keeps `recordSize` from
+        // overflowing
+        || snap->num_edges > snap->size / 4
+        || snap->size != recordSize(snap->num_slots, snap->num_edges)
+    ) {
+        return NULL;
+    }
+    const int n = snap->num_slots;
+    for (int i = 0; i < n; ++i) {
+        if (
+            snap->cells[i] < MP_NULL
+            || snap->cells[i] >= MoonPhase_NumPhases
+            || snap->cells[n + i] < P_NULL
+            || snap->cells[n + i] > P_BLACK
+        ) {
+            return NULL;
+        }
+    }
+    const uint16_t *edges = BoardSnapshot_Edges(snap);
+    for (uint32_t i = 0; i < 2 * snap->num_edges; ++i) {
+        if (edges[i] >= n) {
+            return NULL;
+        }
+    }
+    return snap;
+}
+
+const uint16_t *BoardSnapshot_Edges(const BoardSnapshot *snap) {
+    /* `num_edges` pairs of slot IDs. */
+    return (const uint16_t *) (snap->cells + cellsSize(snap->num_slots));
+}
+
+void GameBoard_LoadSnapshot(GameBoard *board, const BoardSnapshot *snap) {
+    /*
+     * Replace the position of `board` with the one of `snap`, which
+     * must be of a board with the same slots and edges. The Lunar Cycle
+     * graph is rebuilt from the phases.
+     */
+    const int n = board->num_slots;
+    board->claimed[P_WHITE] = board->claimed[P_BLACK] = 0;
+    for (int i = 0; i < n; ++i) {
+        SlotData *data = &board->slots[i];
+        SlotData_Deinit(data);
+        SlotData_Init(data);
+        data->phase = (MoonPhase) BoardSnapshot_Phases(snap)[i];
+        data->owner = (Player) BoardSnapshot_Owners(snap)[i];
+        if (data->owner != P_NULL) {
+            ++board->claimed[data->owner];
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        SlotData *data = &board->slots[i];
+        if (data->phase == MP_NULL) {
+            continue;
+        }
+        const MoonPhase next =
+            (MoonPhase) ((data->phase + 1) % MoonPhase_NumPhases);
+        for (const SlotNode *node = board->adj[i]; node; node = node->next) {
+            SlotData *other = &board->slots[node->slot_id];
+            if (other->phase == next) {
+                SlotNode_ChainPrepend(&data->lc_successors, node->slot_id);
+                SlotNode_ChainPrepend(&other->lc_predecessors, i);
+            }
+        }
+    }
+    board->white_stars = snap->white_stars;
+    board->black_stars = snap->black_stars;
+    board->perks = snap->perks;
+    free(board->view);
+    board->view = NULL;
+}
+
+GameBoard *BoardSnapshot_NewBoard(const BoardSnapshot *snap) {
+    /* Return a new board with the edges and position of `snap`. */
+    GameBoard *board = GameBoard_New(snap->num_slots);
+    const uint16_t *edges = BoardSnapshot_Edges(snap);
+    for (uint32_t i = 0; i < snap->num_edges; ++i) {
+        GameBoard_AddEdge(board, edges[2 * i], edges[2 * i + 1]);
+    }
+    GameBoard_LoadSnapshot(board, snap);
+    return board;
+}
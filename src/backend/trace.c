@@ -0,0 +1,164 @@
+#include "lunar_game.h"
+
+// Recording of trace events for builds with LUNAR_TRACE defined; the
+// rest of the backend only calls into here under that macro.
+
+#ifdef LUNAR_TRACE
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/emscripten.h>
+#endif
+
+// Stop recording (and count the rest as dropped) after this many
+#define TRACE_MAX_EVENTS (1 << 18)
+
+TraceCoreCounters Trace_core;
+
+static TraceEvent *events = NULL;
+static int num_events = 0;
+static int events_capacity = 0;
+static long dropped_events = 0;
+static bool recording = false;
+static int max_ply = 0;
+
+void Trace_Start(int max_span_ply) {
+    /*
+     * Forget the events recorded before and start recording. Search
+     * nodes up to `max_span_ply` plies below the root get a span each.
+     */
+    num_events = 0;
+    dropped_events = 0;
+    max_ply = max_span_ply;
+    recording = true;
+}
+
+void Trace_Stop(void) {
+    recording = false;
+}
+
+bool Trace_IsRecording(void) {
+    return recording;
+}
+
+int Trace_MaxSpanPly(void) {
+    return max_ply;
+}
+
+double Trace_Now(void) {
+    /* Current time in microseconds, from an arbitrary origin. */
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now() * 1000.0;
+#else
+    return (double) clock() * 1e6 / CLOCKS_PER_SEC;
+#endif
+}
+
+TraceEvent *Trace_Add(
+    char ph, const char *cat, const char *name, double ts
+) {
+    /*
+     * Record an event and return it so that the caller can fill in
+     * `dur` and arguments. Return NULL if not recording or out of room.
+     */
+    if (!recording) {
+        return NULL;
+    }
+    if (num_events == events_capacity) {
+        if (events_capacity == TRACE_MAX_EVENTS) {
+            ++dropped_events;
+            return NULL;
+        }
+        events_capacity = events_capacity ? events_capacity * 2 : 1024;
+        events = (TraceEvent *)
+            realloc(events, events_capacity * sizeof(TraceEvent));
+    }
+    TraceEvent *event = &events[num_events++];
+    event->name = name;
+    event->cat = cat;
+    event->ph = ph;
+    event->ts = ts;
+    event->dur = 0;
+    event->num_args = 0;
+    return event;
+}
+
+void TraceEvent_AddArg(TraceEvent *event, const char *name, double value) {
+    /* Does nothing if `event` is NULL or has no room for more. */
+    if (event && event->num_args < TRACE_MAX_ARGS) {
+        event->arg_names[event->num_args] = name;
+        event->args[event->num_args] = value;
+        ++event->num_args;
+    }
+}
+
+typedef struct StringBuilder {
+    char *data;
+    size_t len;
+    size_t capacity;
+} StringBuilder;
+
+static void sbAppend(StringBuilder *sb, const char *format, ...) {
+    va_list ap;
+    for (;;) {
+        va_start(ap, format);
+        const int n = vsnprintf(
+            sb->data + sb->len, sb->capacity - sb->len, format, ap
+        );
+        va_end(ap);
+        if (n < 0) {
+            return;
+        }
+        if (sb->len + n < sb->capacity) {
+            sb->len += n;
+            return;
+        }
+        sb->capacity = (sb->len + n + 1) * 2;
+        sb->data = (char *) realloc(sb->data, sb->capacity);
+    }
+}
+
+char *Trace_ToJSON(void) {
+    /*
+     * Return the events recorded by the last `Trace_Start` in the
+     * Chrome Trace Event Format as a NUL-terminated string, which the
+     * caller must free.
+     */
+    StringBuilder sb;
+    sb.capacity = 256 + (size_t) num_events * 128;
+    sb.data = (char *) malloc(sb.capacity);
+    sb.len = 0;
+    sbAppend(&sb, "{\"traceEvents\":[");
+    for (int i = 0; i < num_events; ++i) {
+        const TraceEvent *e = &events[i];
+        sbAppend(
+            &sb, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+            "\"ts\":%.3f,\"pid\":1,\"tid\":1",
+            i ? "," : "", e->name, e->cat, e->ph, e->ts
+        );
+        if (e->ph == 'X') {
+            sbAppend(&sb, ",\"dur\":%.3f", e->dur);
+        }
+        else if (e->ph == 'i') {
+            sbAppend(&sb, ",\"s\":\"t\"");
+        }
+        sbAppend(&sb, ",\"args\":{");
+        for (int j = 0; j < e->num_args; ++j) {
+            sbAppend(
+                &sb, "%s\"%s\":%.17g", j ? "," : "",
+                e->arg_names[j], e->args[j]
+            );
+        }
+        sbAppend(&sb, "}}");
+    }
+    sbAppend(
+        &sb, "\n],\"displayTimeUnit\":\"ms\","
+        "\"otherData\":{\"dropped_events\":%ld}}\n", dropped_events
+    );
+    return sb.data;
+}
+
+#endif  /* LUNAR_TRACE */
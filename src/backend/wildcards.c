@@ -0,0 +1,239 @@
+#include "lunar_game.h"
+
+// Wildcards are always played by the user, i.e. P_WHITE. Perks are
+// named after whom they favor in the same way.
+
+// Beaver Moon flips a card horizontally, which also swaps New Moons
+// and Full Moons. Indices here are phases.
+static const MoonPhase beaver_moon_flip[MoonPhase_NumPhases] = {
+    MP_FULL, MP_WANING_CRESCENT, MP_FINAL_QUARTER, MP_WANING_GIBBOUS,
+    MP_NEW_MOON, MP_WAXING_GIBBOUS, MP_FIRST_QUARTER, MP_WAXING_CRESCENT,
+};
+
+static int perkOf(WildcardKind kind) {
+    switch (kind) {
+    case WC_SUPER_MOON:
+        return PERK_SUPER_MOON;
+    case WC_SCORPIO:
+    case WC_LONG_NIGHT_MOON:
+        return PERK_SCORPIO;
+    case WC_WINTER_SOLSTICE:
+        return PERK_WINTER_SOLSTICE;
+    case WC_SAGITTARIUS:
+        return PERK_SAGITTARIUS;
+    case WC_LIGHT_OF_MARS:
+        return PERK_LIGHT_OF_MARS;
+    case WC_LIGHT_OF_VENUS:
+        return PERK_LIGHT_OF_VENUS;
+    case WC_MOON_AT_APOGEE:
+        return PERK_MOON_AT_APOGEE;
+    default:
+        return 0;
+    }
+}
+
+bool Wildcard_NeedsTarget(WildcardKind kind) {
+    /* Whether the user has to pick a slot for `kind`. */
+    return kind == WC_BEAVER_MOON || kind == WC_CAPRICORN
+        || kind == WC_WOLF_MOON;
+}
+
+static bool isTarget(const GameBoard *board, int slot_id, bool lunar_only) {
+    /*
+     * Whether `slot_id` has a card on it. If `lunar_only`, the card
+     * must also be claimed by the computer (P_BLACK).
+     */
+    const SlotData *data = &board->slots[slot_id];
+    return lunar_only ? data->owner == P_BLACK : data->phase != MP_NULL;
+}
+
+static void chooseRandom(
+    const GameBoard *board, bool lunar_only, Random *rng, int k,
+    BitSet *out
+) {
+    /*
+     * Add `k` random slots that pass `isTarget` to `out`, or all of
+     * them if there are no more than `k`.
+     */
+    int *ids = (int *) malloc(board->num_slots * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (isTarget(board, i, lunar_only)) {
+            ids[n++] = i;
+        }
+    }
+    if (k > n) {
+        k = n;
+    }
+    // The first `k` steps of a Fisher-Yates shuffle
+    for (int i = 0; i < k; ++i) {
+        const int j = i + Random_Below(rng, n - i);
+        const int chosen = ids[j];
+        ids[j] = ids[i];
+        ids[i] = chosen;
+        BitSet_Set(out, chosen);
+    }
+    free(ids);
+}
+
+static bool applyEffects(
+    GameBoard *board, WildcardKind kind, int target_slot, Random *rng,
+    BitSet *affected, MoonPhase *out_new_card
+) {
+    /*
+     * Do everything `kind` does except placing the new card of Beaver
+     * Moon; its phase goes to `*out_new_card` (MP_NULL for the other
+     * wildcards). `affected` must be cleared by the caller.
+     */
+    *out_new_card = MP_NULL;
+    if (Wildcard_NeedsTarget(kind)) {
+        if (
+            target_slot < 0 || target_slot >= board->num_slots
+            || !isTarget(board, target_slot, kind == WC_WOLF_MOON)
+        ) {
+            return false;
+        }
+        BitSet_Set(affected, target_slot);
+    }
+    switch (kind) {
+    case WC_HUNTER_MOON:
+        for (int i = 0; i < board->num_slots; ++i) {
+            if (isTarget(board, i, true)) {
+                BitSet_Set(affected, i);
+            }
+        }
+        GameBoard_DestroyCards(board, affected);
+        break;
+    case WC_LEONIDS_METEOR_SHOWER:
+        chooseRandom(board, false, rng, 2, affected);
+        GameBoard_DestroyCards(board, affected);
+        break;
+    case WC_QUADRANTIDS_METEOR_SHOWER:
+    case WC_GEMINID_METEOR_SHOWER: {
+        const bool lunar_only = kind == WC_GEMINID_METEOR_SHOWER;
+        int n = 0;
+        for (int i = 0; i < board->num_slots; ++i) {
+            n += isTarget(board, i, lunar_only);
+        }
+        // Half of them, rounding up
+        chooseRandom(board, lunar_only, rng, n - n / 2, affected);
+        if (lunar_only) {
+            GameBoard_SetOwners(board, affected, P_WHITE);
+        }
+        else {
+            GameBoard_DestroyCards(board, affected);
+        }
+        break;
+    }
+    case WC_BEAVER_MOON:
+        *out_new_card = beaver_moon_flip[board->slots[target_slot].phase];
+        GameBoard_DestroyCards(board, affected);
+        break;
+    case WC_CAPRICORN:
+        // The user then places a card there as usual
+        GameBoard_DestroyCards(board, affected);
+        break;
+    case WC_WOLF_MOON:
+        for (SlotNode *n = board->adj[target_slot]; n; n = n->next) {
+            if (board->slots[n->slot_id].owner == P_BLACK) {
+                BitSet_Set(affected, n->slot_id);
+            }
+        }
+        GameBoard_DestroyCards(board, affected);
+        break;
+    case WC_AQUARIUS:
+        // Only gives points at the end of the level, which the host
+        // keeps track of
+        break;
+    default:
+        GameBoard_AddPerks(board, perkOf(kind));
+        break;
+    }
+    return true;
+}
+
+bool GameBoard_ApplyWildcard(
+    GameBoard *board, WildcardKind kind,
+    int target_slot,  /* Ignored unless `Wildcard_NeedsTarget(kind)` */
+    Random *rng,  /* For wildcards that pick slots randomly */
+    BitSet *out_affected,  /* May be NULL */
+    PatternNode **out_patterns  /* May be NULL */
+) {
+    /*
+     * Play wildcard `kind` on `board`. The slots it destroyed or stole
+     * are put in `out_affected`; the patterns formed by the card
+     * Beaver Moon places go to `out_patterns`. Return false and leave
+     * the board alone if `target_slot` is not a valid choice.
+     */
+    BitSet *affected = out_affected ? out_affected
+        : BitSet_New(board->num_slots);
+    BitSet_Zero(affected);
+    MoonPhase new_card;
+    const bool ok = applyEffects(
+        board, kind, target_slot, rng, affected, &new_card
+    );
+    PatternNode *patterns = NULL;
+    if (ok && new_card != MP_NULL) {
+        patterns = GameBoard_PutCard(board, target_slot, new_card, P_WHITE);
+    }
+    if (out_patterns) {
+        *out_patterns = patterns;
+    }
+    else {
+        PatternNode_DeleteChain(patterns);
+    }
+    if (!out_affected) {
+        BitSet_Delete(affected);
+    }
+    return ok;
+}
+
+int GameBoard_ApplyWildcardFlat(
+    GameBoard *board, WildcardKind kind, int target_slot, Random *rng,
+    int *out, int capacity
+) {
+    /*
+     * Same as `GameBoard_ApplyWildcard`, but write the result into
+     * `out`, which has room for `capacity` integers, in this layout:
+     * - Number of slots affected, followed by their ids.
+     * - What `GameBoard_PutCardFlat` gives for the card Beaver Moon
+     *   places; two zeros (no pattern, no owner change) for the other
+     *   wildcards.
+     * Return the number of integers the whole result takes, which may
+     * be greater than `capacity` as in `GameBoard_PutCardFlat`, or -1
+     * if `target_slot` is not a valid choice.
+     */
+    BitSet *affected = BitSet_New(board->num_slots);
+    BitSet_Zero(affected);
+    MoonPhase new_card;
+    if (!applyEffects(board, kind, target_slot, rng, affected, &new_card)) {
+        BitSet_Delete(affected);
+        return -1;
+    }
+    int len = 1;
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (BitSet_Get(affected, i)) {
+            if (len < capacity) {
+                out[len] = i;
+            }
+            ++len;
+        }
+    }
+    if (capacity > 0) {
+        out[0] = len - 1;
+    }
+    BitSet_Delete(affected);
+    if (new_card != MP_NULL) {
+        const bool fits = len < capacity;
+        return len + GameBoard_PutCardFlat(
+            board, target_slot, new_card, P_WHITE,
+            fits ? out + len : out, fits ? capacity - len : 0
+        );
+    }
+    for (int i = 0; i < 2; ++i, ++len) {
+        if (len < capacity) {
+            out[len] = 0;
+        }
+    }
+    return len;
+}
@@ -0,0 +1,171 @@
+// Headless benchmark of the WebAssembly backend.
+// Build the Node.js backends with `python build.py node` first, then
+// run this from anywhere:
+//     node src/bench/bench.mjs [--depth N] [--repeat N] [variant...]
+// Variants are the names in `NODE_BACKEND_VARIANTS` of build.py; every
+// variant that has been built is run by default. All of them replay
+// the same positions on every preset board, so their timings can be
+// compared and their decisions must agree.
+
+import fs from "node:fs";
+import path from "node:path";
+import {performance} from "node:perf_hooks";
+import {fileURLToPath, pathToFileURL} from "node:url";
+import {BackendConstNames} from "../frontend/backend_consts.js";
+import {Boards} from "../frontend/boards.js";
+
+const projectRoot = path.resolve(
+    path.dirname(fileURLToPath(import.meta.url)), "../.."
+);
+const nodeBuildDir = path.join(projectRoot, "build/node");
+
+const cardsInAHand = 3;
+const numPhases = 8;
+const bufferLength = 4096;  // ints
+
+function parseArgs(argv) {
+    const options = {depth: 4, repeat: 3, variants: []};
+    for (let i = 0; i < argv.length; ++i) {
+        const arg = argv[i];
+        if (arg == "--depth" || arg == "--repeat") {
+            options[arg.slice(2)] = Number(argv[++i]);
+        }
+        else {
+            options.variants.push(arg);
+        }
+    }
+    if (options.variants.length == 0) {
+        const pattern = /^backend-(.+)\.mjs$/;
+        for (const file of fs.readdirSync(nodeBuildDir)) {
+            const match = pattern.exec(file);
+            if (match) {
+                options.variants.push(match[1]);
+            }
+        }
+    }
+    return options;
+}
+
+function mulberry32(seed) {
+    // Small seeded PRNG so that every run sees the same positions
+    return () => {
+        seed = (seed + 0x6d2b79f5) | 0;
+        let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+        t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+async function loadBackend(variant) {
+    const file = path.join(nodeBuildDir, `backend-${variant}.mjs`);
+    const {default: getBackend} = await import(pathToFileURL(file).href);
+    const backend = await getBackend();
+    const consts = {};
+    const constsAddr = backend._Glue_IntConstants();
+    for (const [i, name] of BackendConstNames.entries()) {
+        consts[name] = backend.getValue(constsAddr + i * 4, "i32");
+    }
+    const ptr = "number";
+    const aiMove = backend.cwrap(
+        "Glue_AIMove", ptr,
+        [ptr, ptr, "number", "number", "number", "number", ptr, ptr]
+    );
+    return {backend, consts, aiMove};
+}
+
+function setUpPosition({backend, consts}, boardId, buffer) {
+    // Fill a third of the board with random cards, as if both players
+    // had made a few moves, and pick a random hand for the AI.
+    const random = mulberry32(boardId * 7919 + 1);
+    const db = backend._malloc(consts.DisplayableBoardSize);
+    backend._Glue_InitDisplayableBoard(db, boardId);
+    const board = backend.getValue(db + consts.DisplayableBoardBoard, "*");
+    const view = backend._GameBoard_View(board);
+    const numSlots = backend.getValue(view + consts.BoardViewNumSlots, "i32");
+    const empty = Array.from({length: numSlots}, (_, i) => i);
+    for (let i = 0; i < Math.floor(numSlots / 3); ++i) {
+        const [slotId] = empty.splice(Math.floor(random() * empty.length), 1);
+        backend._Glue_PutCard(
+            board, slotId, Math.floor(random() * numPhases),
+            i % 2 == 0 ? consts.PlayerWhite : consts.PlayerBlack,
+            buffer, bufferLength
+        );
+    }
+    const hand = backend._malloc(cardsInAHand * consts.IntSize);
+    for (let i = 0; i < cardsInAHand; ++i) {
+        backend.setValue(
+            hand + i * consts.IntSize, Math.floor(random() * numPhases),
+            "i" + consts.IntSize * 8
+        );
+    }
+    return {db, board, hand};
+}
+
+async function benchVariant(variant, options) {
+    const loaded = await loadBackend(variant);
+    const {backend, consts, aiMove} = loaded;
+    const int = "i" + consts.IntSize * 8;
+    const buffer = backend._malloc(bufferLength * consts.IntSize);
+    const results = [];
+    for (const [name, boardId] of Object.entries(Boards)) {
+        if (name == "length") {
+            continue;
+        }
+        const {db, board, hand} = setUpPosition(loaded, boardId, buffer);
+        let best = Infinity;
+        let decision;
+        for (let r = 0; r < options.repeat; ++r) {
+            const start = performance.now();
+            const d = aiMove(
+                board, hand, cardsInAHand, options.depth, 1, 0, 0, 0
+            );
+            best = Math.min(best, performance.now() - start);
+            decision = [
+                backend.getValue(d + consts.AIDecisionCardId, int),
+                backend.getValue(d + consts.AIDecisionSlotId, int),
+            ];
+            backend._free(d);
+        }
+        results.push({name, ms: best, decision});
+        backend._free(hand);
+        backend._GameBoard_Delete(board);
+        backend._free(db);
+    }
+    backend._free(buffer);
+    return results;
+}
+
+async function main() {
+    const options = parseArgs(process.argv.slice(2));
+    console.log(
+        `depth ${options.depth}, best of ${options.repeat} runs, times in ms`
+    );
+    let reference = null;
+    for (const variant of options.variants) {
+        const results = await benchVariant(variant, options);
+        let total = 0;
+        console.log(`\n${variant}`);
+        for (const {name, ms, decision} of results) {
+            total += ms;
+            console.log(
+                `  ${name.padEnd(20)} ${ms.toFixed(1).padStart(10)}`
+                + `  card ${decision[0]} slot ${decision[1]}`
+            );
+        }
+        console.log(
+            `  ${"total".padEnd(20)} ${total.toFixed(1).padStart(10)}`
+        );
+        const decisions = JSON.stringify(results.map(r => r.decision));
+        if (reference == null) {
+            reference = decisions;
+        }
+        else if (decisions != reference) {
+            console.log(
+                `  WARNING: decisions differ from ${options.variants[0]}`
+            );
+            process.exitCode = 1;
+        }
+    }
+}
+
+await main();
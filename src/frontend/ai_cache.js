@@ -0,0 +1,90 @@
+// Moves of the AI saved in IndexedDB, so that positions seen in earlier
+// sessions need no search. Keys come from `Glue_AICacheKey` (see
+// glue.c); values are {phase, slot, used}, where `used` is when the
+// move was last looked up or saved. Once there are more than
+// `maxEntries` moves, the ones used longest ago are dropped.
+
+const dbName = "lunar-ai-cache";
+const storeName = "moves";
+const maxEntries = 20000;
+// How many moves are saved between checks of the size
+const trimInterval = 100;
+
+function requestPromise(request) {
+    return new Promise((resolve, reject) => {
+        request.onsuccess = () => resolve(request.result);
+        request.onerror = () => reject(request.error);
+    });
+}
+
+export class AICache {
+    static open(version) {
+        // Resolve to the cache for the AI of `version` (the
+        // AICacheVersion constant), or null if there is no IndexedDB.
+        // Moves saved by an AI of another version are dropped.
+        if (!globalThis.indexedDB) {
+            return Promise.resolve(null);
+        }
+        const request = indexedDB.open(dbName, version);
+        request.onupgradeneeded = () => {
+            const db = request.result;
+            if (db.objectStoreNames.contains(storeName)) {
+                db.deleteObjectStore(storeName);
+            }
+            db.createObjectStore(storeName).createIndex("used", "used");
+        };
+        return requestPromise(request)
+            .then(db => new AICache(db))
+            .catch(reason => {
+                console.warn("AI cache unavailable:", reason);
+                return null;
+            });
+    }
+    constructor(db) {
+        this.db = db;
+        this.putsSinceTrim = 0;
+    }
+    get(key) {
+        // Resolve to the [phase, slot] saved under `key` (an
+        // ArrayBuffer), or null
+        const store =
+            this.db.transaction(storeName, "readwrite").objectStore(storeName);
+        return requestPromise(store.get(key))
+            .then(value => {
+                if (!value) {
+                    return null;
+                }
+                value.used = Date.now();
+                store.put(value, key);
+                return [value.phase, value.slot];
+            })
+            .catch(() => null);
+    }
+    put(key, phase, slot) {
+        const store =
+            this.db.transaction(storeName, "readwrite").objectStore(storeName);
+        store.put({phase, slot, used: Date.now()}, key);
+        if (++this.putsSinceTrim >= trimInterval) {
+            this.putsSinceTrim = 0;
+            this.trim();
+        }
+    }
+    trim() {
+        // Drop the moves used longest ago, down to `maxEntries`
+        const store =
+            this.db.transaction(storeName, "readwrite").objectStore(storeName);
+        requestPromise(store.count()).then(count => {
+            let surplus = count - maxEntries;
+            if (surplus <= 0) {
+                return;
+            }
+            store.index("used").openCursor().onsuccess = (event) => {
+                const cursor = event.target.result;
+                if (cursor && surplus-- > 0) {
+                    cursor.delete();
+                    cursor.continue();
+                }
+            };
+        });
+    }
+}
@@ -0,0 +1,113 @@
+// Runs AI searches split among Web Workers, one instance of the backend
+// each (see ai_worker.js). Worker `i` of `n` searches every `n`th root
+// move starting from the `i`th one (`AIOptions.root_split`), and the
+// best of their moves is the one `Glue_AIMove` would play. When the
+// page may share memory with the workers, they also share the best
+// score found so far, so that each can cut short the moves that can't
+// beat it; otherwise they search independently.
+//
+// Messages to a worker:
+//     {type: "search", id, snapshot, choices, depth, split, part, bound}
+//         `snapshot` is an ArrayBuffer with a `BoardSnapshot` (with its
+//         edges) and `bound` a SharedArrayBuffer with the shared score
+//         as a float, or null.
+//     {type: "abort", id}
+//         Return the best move so far, if there is one.
+// Messages from a worker:
+//     {type: "ready"}
+//     {type: "progress", id, movesDone}
+//     {type: "done", id, best: [card, slot] or null, score}
+
+export class AIWorkerPool {
+    constructor(url, size) {
+        this.workers = [];
+        this.lastId = 0;
+        const ready = [];
+        for (let i = 0; i < size; ++i) {
+            const worker = new Worker(url, {type: "module"});
+            ready.push(new Promise((resolve, reject) => {
+                worker.onmessage = (event) => {
+                    if (event.data.type == "ready") {
+                        resolve();
+                    }
+                };
+                worker.onerror = reject;
+            }));
+            this.workers.push(worker);
+        }
+        // Whether every worker has loaded the backend; until then (or
+        // if one of them failed to) searches must not use the pool
+        this.usable = false;
+        Promise.all(ready)
+            .then(() => {
+                this.usable = true;
+            })
+            .catch(reason => {
+                console.warn("AI workers unavailable:", reason);
+                for (const worker of this.workers) {
+                    worker.terminate();
+                }
+            });
+    }
+    search(snapshot, choices, depth, onProgress) {
+        // Search the position in `snapshot`. `onProgress` is called with
+        // the number of root moves searched so far. Return {promise,
+        // abort}; the promise resolves to [card, slot], or null if the
+        // search was aborted before it had a move.
+        const id = ++this.lastId;
+        const split = this.workers.length;
+        let bound = null;
+        if (globalThis.crossOriginIsolated) {
+            bound = new SharedArrayBuffer(4);
+            new Float32Array(bound)[0] = -3.4028234663852886e38;
+        }
+        const movesDone = new Array(split).fill(0);
+        const shares = this.workers.map((worker, part) =>
+            new Promise(resolve => {
+                worker.onmessage = (event) => {
+                    const msg = event.data;
+                    if (msg.id != id) {
+                        return;
+                    }
+                    if (msg.type == "progress") {
+                        movesDone[part] = msg.movesDone;
+                        onProgress(movesDone.reduce((a, b) => a + b));
+                    }
+                    else if (msg.type == "done") {
+                        resolve(msg);
+                    }
+                };
+                worker.postMessage({
+                    type: "search", id, snapshot, choices, depth, split,
+                    part, bound,
+                });
+            })
+        );
+        const promise = Promise.all(shares).then(results => {
+            // Ties go to the move a single search tries first
+            let best = null;
+            for (const res of results) {
+                if (
+                    res.best != null && (
+                        best == null
+                        || res.score > best.score
+                        || res.score == best.score && (
+                            res.best[0] < best.best[0]
+                            || res.best[0] == best.best[0]
+                            && res.best[1] < best.best[1]
+                        )
+                    )
+                ) {
+                    best = res;
+                }
+            }
+            return best && best.best;
+        });
+        const abort = () => {
+            for (const worker of this.workers) {
+                worker.postMessage({type: "abort", id});
+            }
+        };
+        return {promise, abort};
+    }
+}
@@ -0,0 +1,130 @@
+// An AI worker: searches its share of the root moves of an AI move in
+// its own instance of the backend. See ai_pool.js for the messages.
+import {loadBackend} from "./backend_loader.js";
+
+let backend;
+let backendConst;
+let int;
+// The search that is running: its ID and abort flag
+let searchId = null;
+let abortFlag = null;
+// A search runs `stepNodes` nodes at a time until `sliceMillis` have
+// passed, then returns to the event loop to take an abort message
+const stepNodes = 2000;
+const sliceMillis = 50;
+
+function raiseBound(bound, score) {
+    // Atomically raise the float in `bound`, an Int32Array on a
+    // SharedArrayBuffer, to `score` and return the float it holds
+    const bits = new Int32Array(1);
+    const value = new Float32Array(bits.buffer);
+    let old = Atomics.load(bound, 0);
+    for (;;) {
+        bits[0] = old;
+        if (value[0] >= score) {
+            return value[0];
+        }
+        value[0] = score;
+        const seen = Atomics.compareExchange(bound, 0, old, bits[0]);
+        if (seen == old) {
+            return score;
+        }
+        old = seen;
+    }
+}
+
+function runSlices(part) {
+    // Resolve once the search of `Glue_AIMovePartBegin` is done
+    return new Promise(resolve => {
+        const slice = () => {
+            const end = performance.now() + sliceMillis;
+            while (!backend._Glue_AIMovePartStep(part, stepNodes)) {
+                if (performance.now() >= end) {
+                    setTimeout(slice, 0);
+                    return;
+                }
+            }
+            resolve();
+        };
+        slice();
+    });
+}
+
+async function search(msg) {
+    const snapshot = backend._malloc(msg.snapshot.byteLength);
+    backend.HEAP8.set(new Int8Array(msg.snapshot), snapshot);
+    const choices =
+        backend._malloc(msg.choices.length * backendConst.IntSize);
+    for (const [i, phase] of msg.choices.entries()) {
+        backend.setValue(choices + i * backendConst.IntSize, phase, int);
+    }
+    // Our copy of the shared bound, refreshed after every root move
+    const bound = backend._malloc(4);
+    backend.setValue(bound, -3.4028234663852886e38, "float");
+    const sharedBound = msg.bound ? new Int32Array(msg.bound) : null;
+    const progress = backend._malloc(backendConst.AIProgressSize);
+    searchId = msg.id;
+    abortFlag = backend._malloc(backendConst.IntSize);
+    backend.setValue(abortFlag, 0, int);
+    backend.onAIProgress = () => {
+        const score = backend.getValue(
+            progress + backendConst.AIProgressScore, "float"
+        );
+        if (sharedBound) {
+            backend.setValue(bound, raiseBound(sharedBound, score), "float");
+        }
+        postMessage({
+            type: "progress", id: msg.id,
+            movesDone: backend.getValue(
+                progress + backendConst.AIProgressMovesDone, int
+            ),
+        });
+    };
+    const part = backend._Glue_AIMovePartBegin(
+        snapshot, choices, msg.choices.length, msg.depth, msg.split,
+        msg.part, sharedBound ? bound : 0, abortFlag, progress
+    );
+    await runSlices(part);
+    const result = backend._Glue_AIMovePartEnd(part);
+    let best = null;
+    if (result) {
+        best = [
+            backend.getValue(result + backendConst.AIDecisionCardId, int),
+            backend.getValue(result + backendConst.AIDecisionSlotId, int),
+        ];
+    }
+    postMessage({
+        type: "done", id: msg.id, best,
+        score: backend.getValue(
+            progress + backendConst.AIProgressScore, "float"
+        ),
+    });
+    backend._free(result);
+    backend._free(abortFlag);
+    abortFlag = searchId = null;
+    backend._free(progress);
+    backend._free(bound);
+    backend._free(choices);
+    backend._free(snapshot);
+}
+
+// Searches run one after another, as `searchId` and `abortFlag` are
+// those of a single search
+let lastSearch = loadBackend().then(loaded => {
+    backend = loaded.backend;
+    backendConst = loaded.consts;
+    int = 'i' + backendConst.IntSize * 8;
+    postMessage({type: "ready"});
+});
+
+onmessage = (event) => {
+    const msg = event.data;
+    if (msg.type == "abort") {
+        if (searchId == msg.id) {
+            backend.setValue(abortFlag, 1, int);
+        }
+    }
+    else if (msg.type == "search") {
+        lastSearch = lastSearch.then(() => search(msg));
+    }
+};
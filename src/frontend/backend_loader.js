@@ -0,0 +1,30 @@
+// Loading the backend, for the page and the AI workers alike
+import getScalarBackend from "./backend.js";
+import getSimdBackend from "./backend_simd.js";
+import {BackendConstNames} from "./backend_consts.js";
+
+function simdSupported() {
+    // Whether this browser can run the SIMD build of the backend. This
+    // is the smallest module that uses a SIMD instruction.
+    return WebAssembly.validate(new Uint8Array([
+        0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10,
+        10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+    ]));
+}
+
+export async function loadBackend() {
+    // Resolve to the build of the backend that suits this browser and
+    // the constants it exports (see consts_glue.inc)
+    const backend =
+        await (simdSupported() ? getSimdBackend() : getScalarBackend());
+    const consts = {};
+    const constsAddr = backend._Glue_IntConstants();
+    for (const [i, constName] of BackendConstNames.entries()) {
+        consts[constName] = backend.getValue(
+            // 4 bytes in a i32; 8 bits/byte is guaranteed in
+            // WebAssembly.
+            constsAddr + i * 4, 'i32'
+        );
+    }
+    return {backend, consts};
+}
@@ -1,6 +1,7 @@
-import getBackend from "./backend.js";
+import {loadBackend} from "./backend_loader.js";
+import {AIWorkerPool} from "./ai_pool.js";
+import {AICache} from "./ai_cache.js";
 import {Boards} from "./boards.js";
-import {BackendConstNames} from "./backend_consts.js";
 
 const moonPhases = [
     // Must follow the order in src/backend/lunar_game.h
@@ -107,10 +108,29 @@ function externalSvg(url) {
 
 let backend;
 let backendConst = {};
+// An AI search must not start before the last one returned, since
+// there is only one `aiProgressListener`
+let lastAISearch = Promise.resolve();
+// The game whose AI search is running, told about its progress
+let aiProgressListener = null;
+// Object URL of the trace of the last AI search, see `saveAITrace`
+let aiTraceUrl = null;
+let gameLogUrl = null;
 let int;
 let blackStarIcon;
 let whiteStarIcon;
-let AIMove;
+// Searches of at least `parallelAIMinDepth` are split among the workers
+// of `aiPool` (when it is usable), see ai_pool.js
+let aiPool = null;
+const parallelAIMinDepth = 4;
+const maxAIWorkers = 8;
+// Other searches run `aiStepNodes` nodes at a time until
+// `aiSliceMillis` have passed, then let the page go on
+const aiStepNodes = 2000;
+const aiSliceMillis = 12;
+// Moves of the AI on preset boards saved across sessions, see
+// ai_cache.js; null until it is open or if there is no IndexedDB
+let aiCache = null;
 
 externalSvg("images/card.svg")
     .then(cardSvg2 => {
@@ -132,27 +152,25 @@ externalSvg("images/card.svg")
     })
     .then(starSvg2 => {
         starSvg = starSvg2;
-        return getBackend();
+        return loadBackend();
     })
-    .then(backend2 => {
-        backend = backend2;
-        const constsAddr = backend._Glue_IntConstants();
-        for (const [i, constName] of BackendConstNames.entries()) {
-            backendConst[constName] = backend.getValue(
-                // 4 bytes in a i32; 8 bits/byte is guaranteed in
-                // WebAssembly.
-                constsAddr + i * 4, 'i32'
-            );
-        }
+    .then(loaded => {
+        backend = loaded.backend;
+        backendConst = loaded.consts;
         int = 'i' + backendConst.IntSize * 8;
         if (int != 'i16' && int != 'i32') {
             throw "unexpected sizeof(int): " + backendConst.IntSize;
         }
-        const ptr = "number";
-        AIMove = backend.cwrap(
-            "Glue_AIMove", ptr, [ptr, ptr, "number", "number"],
-            {async: true}
-        );
+        backend.onAIProgress = () => aiProgressListener?.onAIProgress();
+        AICache.open(backendConst.AICacheVersion).then(cache => {
+            aiCache = cache;
+        });
+        const cores = navigator.hardwareConcurrency || 1;
+        if (window.Worker && cores > 1) {
+            aiPool = new AIWorkerPool(
+                "ai_worker.min.js", Math.min(cores, maxAIWorkers)
+            );
+        }
         clearInterval(loadingAnimSchedule);  // Turn off animation loop
         enterScene("menu-scene");
         const recordStr = localStorage.getItem("lunar-record");
@@ -171,6 +189,108 @@ externalSvg("images/card.svg")
             "Oops... An error occurred when loading the game: " + reason
     });
 
+function saveGameLog(log) {
+    // Keep the move log of the last game for `downloadGameLog`
+    const text = backend._GameLog_ToText(log);
+    const blob = new Blob(
+        [backend.UTF8ToString(text)], {type: "text/plain"}
+    );
+    backend._free(text);
+    if (gameLogUrl) {
+        URL.revokeObjectURL(gameLogUrl);
+    }
+    gameLogUrl = URL.createObjectURL(blob);
+}
+
+function newAIDecision(cardIndex, slotId) {
+    // An `AIDecision` on the heap, like the ones `Glue_AIMove` returns
+    const decision = backend._malloc(backendConst.AIDecisionSize);
+    backend.setValue(decision + backendConst.AIDecisionCardId, cardIndex, int);
+    backend.setValue(decision + backendConst.AIDecisionSlotId, slotId, int);
+    return decision;
+}
+
+function saveAITrace() {
+    // Only tracing builds of the backend (`build.py --trace`) record
+    // AI searches. Keep the last one for `downloadAITrace`.
+    if (!backend._Glue_TraceJSON) {
+        return;
+    }
+    const json = backend._Glue_TraceJSON();
+    const blob = new Blob(
+        [backend.UTF8ToString(json)], {type: "application/json"}
+    );
+    backend._free(json);
+    if (aiTraceUrl) {
+        URL.revokeObjectURL(aiTraceUrl);
+    }
+    aiTraceUrl = URL.createObjectURL(blob);
+    console.info(
+        "AI search traced, run lunar.downloadAITrace() to save it:",
+        aiTraceUrl
+    );
+}
+
+// Typed array views over the `BoardView` of a game board (see
+// src/backend/lunar_game.h). The backend keeps that memory up to date,
+// so reading board states from here does not call into the backend.
+class BoardStateView {
+    constructor(board) {
+        this.address = backend._GameBoard_View(board);
+        this.numSlots = backend.getValue(
+            this.address + backendConst.BoardViewNumSlots, 'i32'
+        );
+        this.map();
+    }
+    map() {
+        // Views need to be created again if the wasm memory grows.
+        const buffer = backend.HEAP8.buffer;
+        this.buffer = buffer;
+        const pointer =
+            (offset) => backend.getValue(this.address + offset, '*');
+        this.header = new Int32Array(
+            buffer, this.address, backendConst.BoardViewPhases / 4
+        );
+        this.phases = new Int8Array(
+            buffer, pointer(backendConst.BoardViewPhases), this.numSlots
+        );
+        this.owners = new Int8Array(
+            buffer, pointer(backendConst.BoardViewOwners), this.numSlots
+        );
+        this.adjStart = new Int32Array(
+            buffer, pointer(backendConst.BoardViewAdjStart), this.numSlots + 1
+        );
+        this.adj = new Int32Array(
+            buffer, pointer(backendConst.BoardViewAdj),
+            this.adjStart[this.numSlots]
+        );
+    }
+    remapIfNeeded() {
+        if (this.buffer !== backend.HEAP8.buffer) {
+            this.map();
+        }
+    }
+    headerField(offset) {
+        this.remapIfNeeded();
+        return this.header[offset / 4];
+    }
+    get whiteStars() {
+        return this.headerField(backendConst.BoardViewWhiteStars);
+    }
+    get blackStars() {
+        return this.headerField(backendConst.BoardViewBlackStars);
+    }
+    get perks() {
+        return this.headerField(backendConst.BoardViewPerks);
+    }
+    neighbors(slotId) {
+        this.remapIfNeeded();
+        return this.adj.subarray(
+            this.adjStart[slotId], this.adjStart[slotId + 1]
+        );
+    }
+}
+
 function hashEdge(id1, id2) {
     if (id1 > id2) {
         [id1, id2] = [id2, id1];
@@ -206,11 +326,12 @@ const lunarScoreText = document.getElementById("lunar-score-text");
 const dialogueBox = document.getElementById("dialogue-box");
 const dialogueContent = document.getElementById("dialogue-content");
 const starsDiv = document.getElementById("stars");
-const exitButton = document.getElementById("exit-button");
 const wildcardsButton = document.getElementById("wildcards-button");
 const aiLevelSelect = document.getElementById("ai-level-select");
 const gameBoardSelect = document.getElementById("game-board-select");
 const whoStartsSelect = document.getElementById("who-starts-select");
+const boardFileInput = document.getElementById("board-file-input");
+const boardFileError = document.getElementById("board-file-error");
 
 const slotButtonSize = 5.25;  // gh
 const cardSize = slotButtonSize * 1.48;
@@ -267,27 +388,9 @@ dialogueBox.style.opacity = "0";
 function randomInt(below) {
     return Math.floor(Math.random() * below);
 }
-function randomPhase() {
-    return randomInt(moonPhases.length);
-}
 function randomBoard() {
     return randomInt(Boards.length);
 }
-function randomChoose(items, k) {
-    if (items.length < k) {
-        throw new RangeError();
-    }
-    const pool = items.map(item => [Math.random(), item]);
-    pool.sort((a, b) => a[0] - b[0]);
-    const res = [];
-    for (let i = 0; i < k; ++i) {
-        res.push(pool[i][1]);
-    }
-    return res;
-}
-function randomChooseHalf(items) {
-    return randomChoose(items, Math.ceil(items.length / 2));
-}
 function rangeFilter(n, predicate) {
     const res = [];
     for (let i = 0; i < n; ++i) {
@@ -547,6 +650,7 @@ function newLunarCycleSymbol() {
 }
 
 const AILevel = {
+    // Plays one of the best `weakAITopMoves` moves at GREEDY depth
     WEAK: -1,
     // >0 values correspond to depth of search passed to C backend
     GREEDY: 1,
@@ -554,6 +658,7 @@ const AILevel = {
     // 3 has the same effect as 2
     SMARTER: 4,
 };
+const weakAITopMoves = 4;
 const aiLevelDisplayNames = {
     WEAK: "Easy",
     GREEDY: "Medium",
@@ -563,6 +668,9 @@ const aiLevelDisplayNames = {
 
 // Populate AI level select box
 const customGameDefaultAILevel = "GREEDY";
+// When the AI has kept the user waiting this long, it plays the best
+// move it has found so far
+const aiLatencyTargetMs = 8000;
 Object.getOwnPropertyNames(AILevel).forEach(id => {
     const opt = document.createElement("option");
     opt.textContent = aiLevelDisplayNames[id];
@@ -587,10 +695,76 @@ Object.getOwnPropertyNames(Boards).forEach(id => {
     }
     gameBoardSelect.append(opt);
 });
+// The last option loads a board from a file, see boardfile.c for the
+// format
+const boardFileOption = document.createElement("option");
+boardFileOption.textContent = "From File...";
+boardFileOption.value = "file";
+gameBoardSelect.append(boardFileOption);
+let lastGameBoard = gameBoardSelect.value;
+gameBoardSelect.addEventListener("change", () => {
+    if (gameBoardSelect.value == "file") {
+        gameBoardSelect.value = lastGameBoard;
+        boardFileInput.value = "";
+        boardFileInput.click();
+    }
+    else {
+        lastGameBoard = gameBoardSelect.value;
+    }
+});
+boardFileInput.addEventListener("change", async () => {
+    const file = boardFileInput.files[0];
+    if (!file) {
+        return;
+    }
+    const text = await file.text();
+    const size = backend.lengthBytesUTF8(text) + 1;
+    const textPtr = backend._malloc(size);
+    backend.stringToUTF8(text, textPtr, size);
+    const errorSize = 256;
+    const errorPtr = backend._malloc(errorSize);
+    const index = backend._Glue_LoadBoard(textPtr, errorPtr, errorSize);
+    if (index < 0) {
+        boardFileError.textContent =
+            file.name + ": " + backend.UTF8ToString(errorPtr);
+        boardFileError.classList.remove("display-none");
+    }
+    else {
+        boardFileError.classList.add("display-none");
+        const opt = document.createElement("option");
+        opt.textContent = file.name;
+        opt.value = String(Boards.length + index);
+        boardFileOption.before(opt);
+        gameBoardSelect.value = lastGameBoard = opt.value;
+    }
+    backend._free(textPtr);
+    backend._free(errorPtr);
+});
+
+// Number of ints in the buffer that receives the patterns of a move
+const patternBufferLength = 4096;
+
+function parsePatterns(data) {
+    // Decode the result of `GameBoard_PutCardFlat` (see core.c) into
+    // an array of {kind, score, slots}. Owner changes are not needed
+    // for now.
+    const patterns = [];
+    let pos = 1;
+    for (let i = 0; i < data[0]; ++i) {
+        const [kind, score, length] = data.subarray(pos, pos + 3);
+        pos += 3;
+        patterns.push({
+            kind, score, slots: Array.from(data.subarray(pos, pos + length))
+        });
+        pos += length;
+    }
+    return patterns;
+}
 
 class Game {
     constructor(aiLevel, boardType, cardsInAHand) {
         this.aiLevel = aiLevel;
+        this.boardType = boardType;
         this.cardsInAHand = cardsInAHand;
         this.userGoesFirst = true;  // May be altered before calling controller
         const db = backend._malloc(backendConst.DisplayableBoardSize);
@@ -599,6 +773,13 @@ class Game {
         this.board = backend.getValue(
             db + backendConst.DisplayableBoardBoard, '*'
         );
+        // Every random choice of the game comes from the log, so that
+        // `lunar_cli replay` can play the game again
+        this.log = backend._Glue_NewGameLog(
+            boardType, randomInt(2 ** 32), cardsInAHand
+        );
+        this.patternBuffer =
+            backend._malloc(patternBufferLength * backendConst.IntSize);
         this.userCardSelection = null;
         this.userHandInputEnabled = false;
         this.emptySlotsInputEnabled = false;
@@ -636,9 +817,8 @@ class Game {
             dialogueBox.style.height = gh(wrapperRect.height * px2gh);
         }
         // Render the board
-        this.numSlots = backend.getValue(
-            this.board + backendConst.GameBoardNumSlots, int
-        );
+        this.view = new BoardStateView(this.board);
+        this.numSlots = this.view.numSlots;
         const yLenNoPadding = backend.getValue(
             db + backendConst.DisplayableBoardYLen, int
         );
@@ -664,9 +844,6 @@ class Game {
             slotPosPtr += backendConst.SlotPosSize;
         }
         edgesSvg.setAttribute("viewBox", [-Q, -Q, xLen, yLen].join(" "));
-        let adjPtr = backend.getValue(
-            this.board + backendConst.GameBoardAdj, '*'
-        );
         this.edges = new Map();  // `${x},${y}` -> <line> element
         this.slots = [];
         const svgRect = edgesSvg.getBoundingClientRect();
@@ -700,14 +877,9 @@ class Game {
             button.append(buttonIndicator);
             slotsDiv.append(button);
             // Edges
-            const neighbors = [];
+            const neighbors = Array.from(this.view.neighbors(i));
             this.adjList.push(neighbors);
-            let node = backend.getValue(adjPtr, '*');
-            while (!backend._Glue_IsNull(node)) {
-                const slotId = backend.getValue(
-                    node + backendConst.SlotNodeSlotId, int
-                );
-                neighbors.push(slotId);
+            for (const slotId of neighbors) {
                 const hash = hashEdge(slotId, i);
                 if (!this.edges.has(hash)) {
                     const p2 = slotPos[slotId];
@@ -719,14 +891,13 @@ class Game {
                     this.edges.set(hash, new RenderedEdge(p1, p2, i));
                     edgesSvg.append(line);
                 }
-                node = backend.getValue(node + backendConst.SlotNodeNext, '*');
             }
-            adjPtr += backendConst.SlotNodePtrSize;
         }
         // Draw initial cards
         this.userHand = new Array(cardsInAHand).fill(null);
         this.lunarHand = new Array(cardsInAHand).fill(null);
         this.userPlayedCard = this.lunarPlayedCard = cardsInAHand - 1;
+        this.aiAbortFlag = null;
         // Misc...
         this.slotsFilled = 0;
         this.lunarScore = this.userScore = 0;
@@ -795,9 +966,7 @@ class Game {
         }
     }
     async dealUserCard(cardIndex, phase=null) {
-        if (phase == null) {
-            phase = randomPhase();
-        }
+        phase = this.drawCard(backendConst.PlayerWhite, cardIndex, phase);
         const card = newCard();
         const onclick = (event) => {
             if (!this.userHandInputEnabled) {
@@ -820,10 +989,16 @@ class Game {
         card.classList.add("gray", moonPhases[phase]);
         await this.runAnimation(150, new FlipCard2(card));
     }
-    prepareLunarCard(cardIndex, phase=null) {
+    drawCard(player, cardIndex, phase) {
+        // Draw a card at random, unless `phase` is given
         if (phase == null) {
-            phase = randomPhase();
+            return backend._GameLog_Draw(this.log, player, cardIndex);
         }
+        backend._GameLog_Deal(this.log, player, cardIndex, phase);
+        return phase;
+    }
+    prepareLunarCard(cardIndex, phase=null) {
+        phase = this.drawCard(backendConst.PlayerBlack, cardIndex, phase);
         const card = newCard();
         this.lunarHand[cardIndex] = new CardInHand(card, phase);
         card.classList.add("back");
@@ -874,41 +1049,155 @@ class Game {
     computerStartThinking() {  // override-able
         this.prepareLunarCard(this.lunarPlayedCard);
         let aiDepth = this.aiLevel;
+        let topMoves = 1;
         if (aiDepth == AILevel.WEAK) {
-            aiDepth = Math.random() >= 0.5 ? AILevel.GREEDY : 0;
+            aiDepth = AILevel.GREEDY;
+            topMoves = weakAITopMoves;
         }
-        this.didInvokeCAI = aiDepth > 0;
-        if (this.didInvokeCAI) {
-            const aiChoices =
-                backend._malloc(this.cardsInAHand * backendConst.IntSize);
-            for (let i = 0, ptr = aiChoices; i < this.cardsInAHand; ++i) {
-                backend.setValue(ptr, this.lunarHand[i].phase, int);
-                ptr += backendConst.IntSize;
+        const aiChoices =
+            backend._malloc(this.cardsInAHand * backendConst.IntSize);
+        for (let i = 0, ptr = aiChoices; i < this.cardsInAHand; ++i) {
+            backend.setValue(ptr, this.lunarHand[i].phase, int);
+            ptr += backendConst.IntSize;
+        }
+        // Setting this to nonzero stops the search (see `cleanup`)
+        const abortFlag = backend._malloc(backendConst.IntSize);
+        backend.setValue(abortFlag, 0, int);
+        const progress = backend._malloc(backendConst.AIProgressSize);
+        backend.setValue(progress + backendConst.AIProgressMovesDone, 0, int);
+        this.aiAbortFlag = abortFlag;
+        this.aiProgress = progress;
+        this.aiOutOfTime = false;
+        this.resolvedAIDecision = null;
+        const seed = backend._GameLog_AI(
+            this.log, backendConst.PlayerBlack, aiDepth, topMoves
+        );
+        this.aiWorkerSearch = null;
+        const phases = this.lunarHand.map(card => card.phase);
+        this.aiPromise = lastAISearch.then(async () => {
+            aiProgressListener = this;
+            const cacheKey = topMoves == 1
+                ? this.aiCacheKey(aiChoices, aiDepth) : null;
+            const cached = cacheKey && await aiCache.get(cacheKey);
+            if (cached) {
+                // The AI plays the first card of a phase
+                return newAIDecision(phases.indexOf(cached[0]), cached[1]);
             }
-            this.aiPromise = AIMove(
-                this.board, aiChoices, this.cardsInAHand, aiDepth
-            );
-            this.resolvedAIDecision = null;
-            this.aiPromise.then((result) => {
-                backend._free(aiChoices);
-                this.resolvedAIDecision = result;
-            });
-            // Temporarily disable Exit button... It can lead to many
-            // unexpected things when a C function is running.
-            exitButton.setAttribute("disabled", "");
+            const result = aiPool?.usable && topMoves == 1
+                && aiDepth >= parallelAIMinDepth
+                ? await this.parallelAIMove(phases, aiDepth, progress)
+                : await this.steppedAIMove(
+                    aiChoices, aiDepth, topMoves, seed, progress
+                );
+            // Only searches that went all the way are saved
+            if (cacheKey && result && !backend.getValue(abortFlag, int)) {
+                aiCache.put(
+                    cacheKey,
+                    phases[backend.getValue(
+                        result + backendConst.AIDecisionCardId, int
+                    )],
+                    backend.getValue(
+                        result + backendConst.AIDecisionSlotId, int
+                    )
+                );
+            }
+            return result;
+        }).then((result) => {
+            aiProgressListener = null;
+            saveAITrace();
+            backend._free(aiChoices);
+            backend._free(abortFlag);
+            backend._free(progress);
+            this.aiAbortFlag = null;
+            this.aiProgress = null;
+            this.resolvedAIDecision = result;
+            return result;
+        });
+        lastAISearch = this.aiPromise;
+    }
+    parallelAIMove(phases, aiDepth, progress) {
+        // Resolve to what `Glue_AIMove` would, with the search split
+        // among the workers of `aiPool`
+        const size = backend._GameBoard_SnapshotSize(this.board, -1);
+        const snapshotPtr = backend._malloc(size);
+        backend._GameBoard_Snapshot(this.board, -1, snapshotPtr);
+        const snapshot =
+            backend.HEAP8.slice(snapshotPtr, snapshotPtr + size).buffer;
+        backend._free(snapshotPtr);
+        this.aiWorkerSearch = aiPool.search(
+            snapshot, phases, aiDepth, movesDone => {
+                backend.setValue(
+                    progress + backendConst.AIProgressMovesDone,
+                    movesDone, int
+                );
+                this.onAIProgress();
+            }
+        );
+        if (backend.getValue(this.aiAbortFlag, int)) {
+            // Stopped before it started
+            this.aiWorkerSearch.abort();
         }
-        else {
-            // Play randomly...
-            const slotIds = [];
-            for (const [i, slot] of this.slots.entries()) {
-                if (slot.card == null) {
-                    slotIds.push(i);
+        return this.aiWorkerSearch.promise.then(best => {
+            this.aiWorkerSearch = null;
+            return best == null ? 0 : newAIDecision(best[0], best[1]);
+        });
+    }
+    steppedAIMove(aiChoices, aiDepth, topMoves, seed, progress) {
+        // Resolve to what `Glue_AIMove` would, running the search in
+        // slices between which the page stays responsive
+        const search = backend._Glue_AISearchBegin(
+            this.board, aiChoices, this.cardsInAHand, aiDepth, topMoves,
+            this.aiAbortFlag, progress
+        );
+        return new Promise(resolve => {
+            const slice = () => {
+                const end = performance.now() + aiSliceMillis;
+                while (!backend._AISearch_Step(search, aiStepNodes)) {
+                    if (performance.now() >= end) {
+                        setTimeout(slice, 0);
+                        return;
+                    }
                 }
-            }
-            this.resolvedAIDecision = [
-                randomInt(this.cardsInAHand),
-                slotIds[randomInt(slotIds.length)]
-            ];
+                resolve(backend._Glue_AISearchEnd(search, topMoves, seed));
+            };
+            setTimeout(slice, 0);
+        });
+    }
+    aiCacheKey(aiChoices, aiDepth) {
+        // The key of the AI move in `aiCache`, or null if it must not be
+        // looked up (on boards loaded from files, whose IDs change
+        // from session to session)
+        if (aiCache == null || this.boardType >= Boards.length) {
+            return null;
+        }
+        const capacity = 6 + this.cardsInAHand + this.slots.length;
+        const key = backend._malloc(capacity);
+        const length = backend._Glue_AICacheKey(
+            this.board, this.boardType, aiChoices, this.cardsInAHand,
+            aiDepth, key
+        );
+        const res = backend.HEAP8.slice(key, key + length).buffer;
+        backend._free(key);
+        return res;
+    }
+    stopAI() {
+        // Make the AI search return the best move it has so far
+        backend.setValue(this.aiAbortFlag, 1, int);
+        this.aiWorkerSearch?.abort();
+    }
+    onAIProgress() {
+        // Called by the backend after each move the AI has weighed
+        if (this.aiOutOfTime) {
+            this.hurryAI();
+        }
+    }
+    hurryAI() {
+        // Stop the search if it already has a move to offer
+        const movesDone = backend.getValue(
+            this.aiProgress + backendConst.AIProgressMovesDone, int
+        );
+        if (movesDone > 0) {
+            this.stopAI();
         }
     }
     filterSlot(slotId) {  // override-able
@@ -957,25 +1246,85 @@ class Game {
         );
         // Move card from #user-hand to #game-board-cards
         gameBoardCardsDiv.append(card.element);
-        await this.showAndDeletePatterns(patterns, slotId, "white");
+        await this.showPatterns(patterns, slotId, "white");
     }
     simplyPlaceUserCard(phase, slotId, cardElement) {
+        this.trackUserCard(phase, slotId, cardElement);
+        return this.putCard(slotId, phase, backendConst.PlayerWhite);
+    }
+    trackUserCard(phase, slotId, cardElement) {
+        // Record a card of the user that is already on the backend board
         ++this.slotsFilled;
         const slot = this.slots[slotId];
         slot.card = cardElement;
         slot.cardColor = "gray";
         slot.phase = phase;
-        return backend._Glue_PutCard(
-            this.board, slotId, phase, backendConst.PlayerWhite
+    }
+    putCard(slotId, phase, player) {
+        // Return the patterns formed, see `parsePatterns`
+        backend._GameLog_Play(
+            this.log, player,
+            player == backendConst.PlayerWhite ? this.userPlayedCard
+                : this.lunarPlayedCard,
+            slotId
         );
+        const length = backend._Glue_PutCard(
+            this.board, slotId, phase, player,
+            this.patternBuffer, patternBufferLength
+        );
+        if (length > patternBufferLength) {
+            throw new Error(`pattern buffer too small (${length} needed)`);
+        }
+        const start = this.patternBuffer / 4;
+        return parsePatterns(backend.HEAP32.subarray(start, start + length));
+    }
+    applyWildcard(wildcardId, targetSlot=-1) {
+        // Play a wildcard on the backend board. Return null if
+        // `targetSlot` can't be chosen, otherwise {affected, patterns}:
+        // the slots destroyed or stolen, and the patterns formed by the
+        // card Beaver Moon places.
+        const seed = backend._GameLog_Wildcard(
+            this.log, backendConst.PlayerWhite, wildcardId, targetSlot
+        );
+        const length = backend._Glue_ApplyWildcard(
+            this.board, wildcardId, targetSlot, seed,
+            this.patternBuffer, patternBufferLength
+        );
+        if (length < 0) {
+            return null;
+        }
+        if (length > patternBufferLength) {
+            throw new Error(`pattern buffer too small (${length} needed)`);
+        }
+        this.perks = this.view.perks;
+        const start = this.patternBuffer / 4;
+        const data = backend.HEAP32.subarray(start, start + length);
+        const numAffected = data[0];
+        return {
+            affected: Array.from(data.subarray(1, 1 + numAffected)),
+            patterns: parsePatterns(data.subarray(1 + numAffected)),
+        };
     }
     async computerDecisionRequired() {  // override-able
-        if (!this.didInvokeCAI) {
-            return this.resolvedAIDecision;
+        let aiDecision = this.resolvedAIDecision;
+        if (aiDecision == null) {
+            lunarHandDiv.classList.add("thinking");
+            const timer = setTimeout(() => {
+                this.aiOutOfTime = true;
+                if (this.aiAbortFlag != null) {
+                    this.hurryAI();
+                }
+            }, aiLatencyTargetMs);
+            aiDecision = await this.aiPromise;
+            clearTimeout(timer);
+            lunarHandDiv.classList.remove("thinking");
         }
-        const aiDecision = this.resolvedAIDecision ?? (await this.aiPromise);
-        // C function has finished, resume exit button
-        exitButton.removeAttribute("disabled");
+        if (this.abortSignal.aborted) {
+            // The search may have been stopped; `cleanup` takes care
+            // of the decision.
+            throw ABORTED;
+        }
+        this.resolvedAIDecision = null;
         const cardIndex = backend.getValue(
             aiDecision + backendConst.AIDecisionCardId, int
         );
@@ -1021,10 +1370,10 @@ class Game {
         card.element.classList.remove("back");
         card.element.classList.add("gray", moonPhases[card.phase]);
         await this.runAnimation(150, new FlipCard2(card.element));
-        const patterns = backend._Glue_PutCard(
-            this.board, slotId, card.phase, backendConst.PlayerBlack
+        const patterns = this.putCard(
+            slotId, card.phase, backendConst.PlayerBlack
         );
-        await this.showAndDeletePatterns(patterns, slotId, "black");
+        await this.showPatterns(patterns, slotId, "black");
     }
     scaleCards(slotIds, bigger) {
         const [to, from] = bigger ? [largeCardScale, 1] : [1, largeCardScale];
@@ -1144,108 +1493,57 @@ class Game {
         symbol.setAttribute("y1", p1[1]);
         return [symbol, p1, p2];
     }
-    async showAndDeletePatterns(patterns, subjectSlot, color) {
-        try {
-            await this.showPatterns(patterns, subjectSlot, color);
-        }
-        finally {
-            // In case an ABORT happens...
-            backend._PatternNode_DeleteChain(patterns);
-        }
-    }
     async showPatterns(patterns, subjectSlot, color) {
-        const fullMoonBonus = (
-            color == "white" && (this.perks & backendConst.PerkSuperMoon)
-        ) ? 2 : 0;
-        const lunarCycleBonus = (
-            color == "white" && (this.perks & backendConst.PerkLightOfMars)
-        ) ? 2 : 0;
+        // `patterns` is what `putCard` returns
         const alwaysOnePoint = (
             color == "black" && (this.perks & backendConst.PerkMoonAtApogee)
         );
         const canSteal = !(
             color == "black" && (this.perks & backendConst.PerkWinterSolstice)
         );
-        const triplePoints = (
-            color == "white" && (this.perks & backendConst.PerkSagittarius)
-        );
-        // Sagittarius is one-shot
-        if (triplePoints && !backend._Glue_IsNull(patterns)) {
-            this.perks &= ~backendConst.PerkSagittarius;
-        }
-        let node = patterns;
-        while (!backend._Glue_IsNull(node)) {
-            const pattern = backend.getValue(
-                node + backendConst.PatternNodePattern, '*'
-            );
-            const kind = backend._Glue_PatternKind(pattern);
+        for (const pattern of patterns) {
             let text;
             let starredSlots = [subjectSlot];
             let showStarsOneByOne = false;
-            const occupiedSlots = [];
+            const occupiedSlots = pattern.slots;
             const edgeAnimations = [];
-            let bonus = 0;
-            switch (kind) {
+            switch (pattern.kind) {
             case backendConst.PkPhasePair: {
                 text = "Phase Pair";
-                const otherId = backend.getValue(
-                    pattern + backendConst.PatternOtherId, int
-                );
-                occupiedSlots.push(subjectSlot, otherId);
                 edgeAnimations.push(new FadeIn(
-                    this.phasePairSymbol(subjectSlot, otherId)
+                    this.phasePairSymbol(...occupiedSlots)
                 ));
                 break;
             }
             case backendConst.PkFullMoon: {
                 text = "Full Moon Pair";
-                const otherId = backend.getValue(
-                    pattern + backendConst.PatternOtherId, int
-                );
                 if (!alwaysOnePoint) {
                     starredSlots = occupiedSlots;
-                    bonus += fullMoonBonus;
                 }
-                occupiedSlots.push(subjectSlot, otherId);
                 edgeAnimations.push(new FadeIn(
-                    this.fullMoonSymbol(subjectSlot, otherId)
+                    this.fullMoonSymbol(...occupiedSlots)
                 ));
                 break;
             }
             case backendConst.PkLunarCycle: {
-                let node = backend.getValue(
-                    pattern + backendConst.PatternList, '*'
-                );
-                let lastSlot = null;
-                while (!backend._Glue_IsNull(node)) {
-                    const thisSlot = backend.getValue(
-                        node + backendConst.SlotNodeSlotId, int
-                    );
-                    occupiedSlots.push(thisSlot);
-                    if (lastSlot != null) {
-                        edgeAnimations.push(new DrawLine(
-                            ...this.lunarCycleSymbol(lastSlot, thisSlot)
-                        ));
-                    }
-                    lastSlot = thisSlot;
-                    node = backend.getValue(
-                        node + backendConst.SlotNodeNext, '*'
-                    );
+                for (let i = 1; i < occupiedSlots.length; ++i) {
+                    edgeAnimations.push(new DrawLine(...this.lunarCycleSymbol(
+                        occupiedSlots[i - 1], occupiedSlots[i]
+                    )));
                 }
                 if (!alwaysOnePoint) {
                     starredSlots = occupiedSlots;
-                    bonus += lunarCycleBonus;
                 }
                 text = `Lunar Cycle of ${occupiedSlots.length}`;
                 showStarsOneByOne = true;
                 break;
             }
             default:
-                throw `invalid pattern kind ${kind}`;
-            }
-            if (triplePoints) {
-                bonus += 2 * (bonus + starredSlots.length);
+                throw `invalid pattern kind ${pattern.kind}`;
             }
+            // The backend has applied the perks to the score already;
+            // whatever is not shown as a star on a card is a bonus.
+            const bonus = pattern.score - starredSlots.length;
             let owningSlots;
             if (canSteal) {
                 owningSlots = occupiedSlots;
@@ -1284,9 +1582,6 @@ class Game {
             if (bonus > 0) {
                 await this.bonusStarsProcedure(bonus, color);
             }
-            node = backend.getValue(
-                node + backendConst.PatternNodeNext, '*'
-            );
         }
     }
     async bonusStarsProcedure(bonus, color, message="Wildcard bonus") {
@@ -1336,6 +1631,8 @@ class Game {
         }
     }
     async destroyCards(slotIds) {
+        // Take the cards away from the screen; the backend must have
+        // destroyed them already
         const edges = new Set();
         for (const slotId of slotIds) {
             for (const neighbor of this.adjList[slotId]) {
@@ -1361,7 +1658,6 @@ class Game {
             slot.card = null;
             slot.cardColor = null;
             slot.phase = null;
-            backend._GameBoard_DestroyCard(this.board, slotId);
         }
         for (const symbol of edgeSymbols) {
             symbol.remove();
@@ -1375,8 +1671,31 @@ class Game {
         this.cleanup();
     }
     cleanup() {
-        backend._free(this.displayableBoard);
-        backend._GameBoard_Delete(this.board);
+        const release = () => {
+            if (this.slotsFilled == this.slots.length) {
+                backend._GameLog_End(this.log, this.board);
+            }
+            saveGameLog(this.log);
+            backend._GameLog_Delete(this.log);
+            backend._free(this.patternBuffer);
+            backend._free(this.displayableBoard);
+            backend._GameBoard_Delete(this.board);
+        };
+        if (this.aiAbortFlag != null) {
+            // The AI is still searching on our board. Ask it to stop
+            // and release everything once it has returned.
+            this.stopAI();
+            this.aiPromise.then((aiDecision) => {
+                backend._free(aiDecision);  // NULL if the search stopped
+                release();
+            });
+            return;
+        }
+        if (this.resolvedAIDecision != null) {
+            // The AI has decided but the game ended before its turn
+            backend._free(this.resolvedAIDecision);
+        }
+        release();
     }
     cleanDom() {
         this.cleanedDom = true;
@@ -1621,20 +1940,15 @@ async function perkMessage(game, message) {
     await game.hideDialogueBox();
 }
 
-function perkSetter(perkName, message) {
-    return async (game) => {
-        const perkFlag = backendConst[perkName];
-        game.perks |= perkFlag;
-        const perksPtr = game.board + backendConst.GameBoardPerks;
-        backend.setValue(
-            perksPtr, backend.getValue(perksPtr, int) | perkFlag, int
-        );
+function perkSetter(message) {
+    // The perk comes from the backend, see `perkOf` in wildcards.c
+    return async function (game) {
+        game.applyWildcard(this.id);
         await perkMessage(game, message);
     };
 }
 
 const runScorpioPerk = perkSetter(
-    "PerkScorpio",
     "The Half Moon won't get end game bonus points."
 );
 const scorpioDescription =
@@ -1654,7 +1968,7 @@ const Wildcards = {
             "Destroy all cards controlled by the Half Moon on the board.",
         uv: [0, 0],
         async run(game) {
-            await game.destroyCards(getLunarSlots(game));
+            await game.destroyCards(game.applyWildcard(this.id).affected);
         },
     },
     SUPER_MOON: {
@@ -1665,7 +1979,6 @@ const Wildcards = {
             + " level.",
         uv: [1, 0],
         run: perkSetter(
-            "PerkSuperMoon",
             "Your Full Moon Pairs will be worth double."
         ),
     },
@@ -1684,19 +1997,7 @@ const Wildcards = {
         description: "Destroy 2 random cards on the board.",
         uv: [3, 0],
         async run(game) {
-            const slotIds = getNonEmptySlots(game);
-            let destroys;
-            if (slotIds.length > 2) {
-                const aIdx = randomInt(slotIds.length);
-                const a = slotIds[aIdx];
-                slotIds.splice(aIdx, 1);
-                const b = slotIds[randomInt(slotIds.length)];
-                destroys = [a, b];
-            }
-            else {
-                destroys = slotIds;
-            }
-            await game.destroyCards(destroys);
+            await game.destroyCards(game.applyWildcard(this.id).affected);
         },
     },
     WINTER_SOLSTICE: {
@@ -1707,7 +2008,6 @@ const Wildcards = {
             "Your claimed cards can not be stolen for the current level.",
         uv: [0, 1],
         run: perkSetter(
-            "PerkWinterSolstice",
             "The Half Moon won't be able to steal your cards for the current"
             + " level."
         ),
@@ -1732,13 +2032,12 @@ const Wildcards = {
             await game.hideDialogueBox();
             const slot = game.slots[slotId];
             const phase = beaverMoonTransform[slot.phase];
+            const {patterns} = game.applyWildcard(this.id, slotId);
             await game.destroyCards([slotId]);
             const cardElement = newCard();
             cardElement.classList.add("gray", moonPhases[phase]);
             cardElement.style.top = gh(slot.centerPosYGh - halfCardSize);
-            const patterns = game.simplyPlaceUserCard(
-                phase, slotId, cardElement
-            );
+            game.trackUserCard(phase, slotId, cardElement);
             gameBoardCardsDiv.append(cardElement);
             await game.runAnimation(500,
                 new TranslateX(
@@ -1746,7 +2045,7 @@ const Wildcards = {
                     slot.centerPosXGh - halfCardSize
                 ),
             );
-            await game.showAndDeletePatterns(patterns, slotId, "white");
+            await game.showPatterns(patterns, slotId, "white");
         },
     },
     SAGITTARIUS: {
@@ -1758,7 +2057,6 @@ const Wildcards = {
             + " make multiple matches in one move, all matches get tripled.",
         uv: [2, 1],
         run: perkSetter(
-            "PerkSagittarius",
             "Your next match(es) will receive triple points."
         ),
     },
@@ -1771,7 +2069,7 @@ const Wildcards = {
             + "board.",
         uv: [3, 1],
         async run(game) {
-            const slots = randomChooseHalf(getLunarSlots(game));
+            const slots = game.applyWildcard(this.id).affected;
             for (const slotId of slots) {
                 game.slots[slotId].setCardColor("gray");
             }
@@ -1779,9 +2077,6 @@ const Wildcards = {
             await game.sleep(500);
             for (const slotId of slots) {
                 game.slots[slotId].setCardColor("white");
-                backend._Glue_ChangeSlotOwner(
-                    game.board, slotId, backendConst.PlayerWhite
-                );
             }
             await game.sleep(500);
             await game.scaleCards(slots, false);
@@ -1802,7 +2097,7 @@ const Wildcards = {
         description: "Randomly destroys half the cards on the board.",
         uv: [1, 2],
         async run(game) {
-            await game.destroyCards(randomChooseHalf(getNonEmptySlots(game)));
+            await game.destroyCards(game.applyWildcard(this.id).affected);
         },
     },
     LIGHT_OF_MARS: {
@@ -1813,7 +2108,6 @@ const Wildcards = {
             "Makes your Lunar Cycles worth +2 points for the current level.",
         uv: [2, 2],
         run: perkSetter(
-            "PerkLightOfMars",
             "Your Lunar Cycles will be worth +2 points."
         ),
     },
@@ -1840,6 +2134,7 @@ const Wildcards = {
             game.userHandInputEnabled = false;
             userHandDiv.classList.remove("enabled");
             await game.hideDialogueBox();
+            game.applyWildcard(this.id, slotId);
             await game.destroyCards([slotId]);
             setTimeout(() => {
                 game.onUserPlaceCard(slotId);
@@ -1869,7 +2164,6 @@ const Wildcards = {
             + " current level.",
         uv: [1, 3],
         run: perkSetter(
-            "PerkLightOfVenus",
             "Your end game bonus points will be doubled."
         ),
     },
@@ -1882,7 +2176,6 @@ const Wildcards = {
             + " level.",
         uv: [2, 3],
         run: perkSetter(
-            "PerkMoonAtApogee",
             "The Half Moon's matches will all be worth 1 point."
         ),
     },
@@ -1905,14 +2198,10 @@ const Wildcards = {
                 "Choose a card claimed by the Half Moon"
             );
             const slotId = await askForSlot(game, selectable);
-            const destroying = [slotId];
-            for (const neighbor of game.adjList[slotId]) {
-                if (game.slots[neighbor].cardColor == "black") {
-                    destroying.push(neighbor);
-                }
-            }
             await game.hideDialogueBox();
-            await game.destroyCards(destroying);
+            await game.destroyCards(
+                game.applyWildcard(this.id, slotId).affected
+            );
         },
     },
 };
@@ -2357,6 +2646,32 @@ export async function hidePopup() {
 
 export let onQuit;
 
+export function downloadAITrace() {
+    // Save the trace of the last AI search as a file that trace
+    // viewers such as https://ui.perfetto.dev/ can open
+    if (!aiTraceUrl) {
+        console.warn("No AI search has been traced; see build.py --trace");
+        return;
+    }
+    const link = document.createElement("a");
+    link.href = aiTraceUrl;
+    link.download = "lunar-ai-trace.json";
+    link.click();
+}
+
+export function downloadGameLog() {
+    // Save the move log of the last game, which `lunar_cli replay` can
+    // check and time again
+    if (!gameLogUrl) {
+        console.warn("No game has been played yet");
+        return;
+    }
+    const link = document.createElement("a");
+    link.href = gameLogUrl;
+    link.download = "lunar-game.log";
+    link.click();
+}
+
 export async function onExitGame() {
     onQuit = async () => {
         await hidePopup();
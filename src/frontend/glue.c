@@ -3,6 +3,11 @@
 #include <stddef.h>  /* offsetof() used in consts_glue.inc */
 #include <emscripten/emscripten.h>
 
+// Version of the keys and moves ai_cache.js saves across sessions; bump
+// it whenever the AI may come to other moves than before, which makes
+// the browser drop the moves it saved
+#define AI_CACHE_VERSION 1
+
 static const int32_t exported_constants[] = {
 #define ITEM(name, value) value,
 #include "consts_glue.inc"
@@ -13,36 +18,302 @@ const int32_t * EMSCRIPTEN_KEEPALIVE Glue_IntConstants(void) {
     return exported_constants;
 }
 
-PatternNode * EMSCRIPTEN_KEEPALIVE Glue_PutCard(
-    GameBoard *board, int slot_id, int phase, int player
+int EMSCRIPTEN_KEEPALIVE Glue_PutCard(
+    GameBoard *board, int slot_id, int phase, int player,
+    int *out, int capacity
 ) {
-    return GameBoard_PutCard(
-        board, slot_id, (MoonPhase) phase, (Player) player
+    return GameBoard_PutCardFlat(
+        board, slot_id, (MoonPhase) phase, (Player) player, out, capacity
     );
 }
 
-int EMSCRIPTEN_KEEPALIVE Glue_PatternKind(const Pattern *p) {
-    return (int) p->kind;
+EM_JS(void, notifyAIProgress, (void), {
+    if (Module["onAIProgress"]) {
+        Module["onAIProgress"]();
+    }
+});
+
+static void copyAIProgress(const AIProgress *progress, void *userdata) {
+    *(AIProgress *) userdata = *progress;
+    notifyAIProgress();
 }
 
-bool EMSCRIPTEN_KEEPALIVE Glue_IsNull(void *ptr) {
-    return ptr == NULL;
+static AIDecision *pickAmongBest(
+    AIRankedMove *ranking, int num_moves, int top_k, unsigned seed
+) {
+    /* Pick one of the best `top_k` moves in `ranking` and free it. */
+    if (!ranking) {
+        return NULL;
+    }
+    Random rng;
+    Random_Seed(&rng, seed);
+    AIDecision *res = malloc(sizeof(AIDecision));
+    *res = ranking[Random_Below(
+        &rng, num_moves < top_k ? num_moves : top_k
+    )].decision;
+    free(ranking);
+    return res;
 }
 
 AIDecision * EMSCRIPTEN_KEEPALIVE Glue_AIMove(
-    const GameBoard *board, const int *choices, int num_choices, int depth
+    const GameBoard *board, const int *choices, int num_choices, int depth,
+    int top_k, unsigned seed, const int *abort_flag, AIProgress *progress
 ) {
+    /*
+     * Play the best move, or if `top_k` > 1, one of the best `top_k`
+     * moves picked at random with `seed`. If `progress` is not NULL,
+     * it is updated and `Module.onAIProgress` is called after every
+     * root move. If `*abort_flag` was set during the search, return
+     * the best move so far (or one of the best so far) or NULL if
+     * there's none.
+     */
     MoonPhase *new_choices = malloc(sizeof(MoonPhase) * num_choices);
     for (int i = 0; i < num_choices; ++i) {
         new_choices[i] = (MoonPhase) choices[i];
     }
-    AIDecision *res = AIMove(board, new_choices, num_choices, depth);
+    AIOptions options;
+    AIOptions_Init(&options);
+    options.abort_flag = abort_flag;
+    if (progress) {
+        progress->moves_done = 0;
+        options.on_progress = copyAIProgress;
+        options.progress_userdata = progress;
+    }
+#ifdef LUNAR_TRACE
+    Trace_Start(1);
+#endif
+    AIDecision *res;
+    if (top_k > 1) {
+        int num_moves;
+        AIRankedMove *ranking = AIRankMoves(
+            board, new_choices, num_choices, depth, top_k, &options,
+            &num_moves, NULL
+        );
+        res = pickAmongBest(ranking, num_moves, top_k, seed);
+    }
+    else {
+        res = AIMoveWithOptions(
+            board, new_choices, num_choices, depth, &options, NULL
+        );
+    }
+#ifdef LUNAR_TRACE
+    Trace_Stop();
+#endif
     free(new_choices);
     return res;
 }
 
-void EMSCRIPTEN_KEEPALIVE Glue_ChangeSlotOwner(
-    GameBoard *board, int slot_id, int owner
+AISearch * EMSCRIPTEN_KEEPALIVE Glue_AISearchBegin(
+    const GameBoard *board, const int *choices, int num_choices, int depth,
+    int top_k, const int *abort_flag, AIProgress *progress
 ) {
-    board->slots[slot_id].owner = (Player) owner;
+    /*
+     * Set up the search of `Glue_AIMove` for the page to run a slice at
+     * a time with `AISearch_Step`, then finish with `Glue_AISearchEnd`.
+     */
+    MoonPhase *new_choices = malloc(sizeof(MoonPhase) * num_choices);
+    for (int i = 0; i < num_choices; ++i) {
+        new_choices[i] = (MoonPhase) choices[i];
+    }
+    AIOptions options;
+    AIOptions_Init(&options);
+    options.abort_flag = abort_flag;
+    if (progress) {
+        progress->moves_done = 0;
+        options.on_progress = copyAIProgress;
+        options.progress_userdata = progress;
+    }
+#ifdef LUNAR_TRACE
+    Trace_Start(1);
+#endif
+    AISearch *search = top_k > 1
+        ? AISearch_BeginRanking(
+            board, new_choices, num_choices, depth, top_k, &options
+        )
+        : AISearch_Begin(board, new_choices, num_choices, depth, &options);
+    free(new_choices);
+    return search;
+}
+
+AIDecision * EMSCRIPTEN_KEEPALIVE Glue_AISearchEnd(
+    AISearch *search, int top_k, unsigned seed
+) {
+    /*
+     * Delete a search of `Glue_AISearchBegin`, done or not, and return
+     * the move `Glue_AIMove` would with the same `top_k` and `seed`
+     * among those searched, or NULL if there's none.
+     */
+    AIDecision *res;
+    if (top_k > 1) {
+        int num_moves;
+        AIRankedMove *ranking = AISearch_Ranking(search, &num_moves);
+        res = pickAmongBest(ranking, num_moves, top_k, seed);
+    }
+    else {
+        res = AISearch_Result(search, NULL);
+    }
+    AISearch_Delete(search);
+#ifdef LUNAR_TRACE
+    Trace_Stop();
+#endif
+    return res;
+}
+
+// A share of the search of an AI move, see `Glue_AIMovePartBegin`
+typedef struct PartSearch {
+    GameBoard *board;  /* Whose edges `search` shares */
+    AISearch *search;
+} PartSearch;
+
+PartSearch * EMSCRIPTEN_KEEPALIVE Glue_AIMovePartBegin(
+    const BoardSnapshot *snapshot, const int *choices, int num_choices,
+    int depth, int root_split, int root_part, const float *shared_bound,
+    const int *abort_flag, AIProgress *progress
+) {
+    /*
+     * Set up the search of a share of the root moves of `Glue_AIMove`
+     * (with `top_k` 1) for the position in `snapshot`; see
+     * `AIOptions.root_split`. This is what the AI workers run, a slice
+     * at a time with `Glue_AIMovePartStep`, then finish with
+     * `Glue_AIMovePartEnd`. `progress` must not be NULL; its `best` and
+     * `score` are what the share came to.
+     */
+    PartSearch *part = malloc(sizeof(PartSearch));
+    part->board = BoardSnapshot_NewBoard(snapshot);
+    MoonPhase *new_choices = malloc(sizeof(MoonPhase) * num_choices);
+    for (int i = 0; i < num_choices; ++i) {
+        new_choices[i] = (MoonPhase) choices[i];
+    }
+    AIOptions options;
+    AIOptions_Init(&options);
+    options.abort_flag = abort_flag;
+    options.root_split = root_split;
+    options.root_part = root_part;
+    options.shared_bound = shared_bound;
+    progress->moves_done = 0;
+    options.on_progress = copyAIProgress;
+    options.progress_userdata = progress;
+    part->search = AISearch_Begin(
+        part->board, new_choices, num_choices, depth, &options
+    );
+    free(new_choices);
+    return part;
+}
+
+bool EMSCRIPTEN_KEEPALIVE Glue_AIMovePartStep(
+    PartSearch *part, long node_budget
+) {
+    return AISearch_Step(part->search, node_budget);
+}
+
+AIDecision * EMSCRIPTEN_KEEPALIVE Glue_AIMovePartEnd(PartSearch *part) {
+    /*
+     * Delete a search of `Glue_AIMovePartBegin`, done or not, and return
+     * the best move of the share, or NULL if there's none.
+     */
+    AIDecision *res = AISearch_Result(part->search, NULL);
+    AISearch_Delete(part->search);
+    GameBoard_Delete(part->board);
+    free(part);
+    return res;
+}
+
+int EMSCRIPTEN_KEEPALIVE Glue_AICacheKey(
+    const GameBoard *board, int board_id, const int *choices,
+    int num_choices, int depth, unsigned char *out
+) {
+    /*
+     * Write the key ai_cache.js saves the move of `Glue_AIMove` (with
+     * `top_k` 1) under to `out`, which must have room for 6 +
+     * `num_choices` + `board->num_slots` bytes, and return its length.
+     * It holds what the move depends on: the depth, the preset board,
+     * the perks, the hand, and the phase and owner of every slot. Stars
+     * only add the same to every score, so they are left out. The hand
+     * is written one phase at a time in the order the phases first
+     * appear in it, which is all that tells two hands apart for the
+     * AI; the move is then saved as a phase rather than a card.
+     */
+    int len = 0;
+    out[len++] = AI_CACHE_VERSION;
+    out[len++] = (unsigned char) depth;
+    out[len++] = (unsigned char) (board_id & 0xff);
+    out[len++] = (unsigned char) (board_id >> 8);
+    out[len++] = (unsigned char) board->perks;
+    out[len++] = (unsigned char) num_choices;
+    unsigned seen = 0;
+    for (int i = 0; i < num_choices; ++i) {
+        if (seen & (1u << choices[i])) {
+            continue;
+        }
+        seen |= 1u << choices[i];
+        for (int j = i; j < num_choices; ++j) {
+            if (choices[j] == choices[i]) {
+                out[len++] = (unsigned char) choices[i];
+            }
+        }
+    }
+    for (int i = 0; i < board->num_slots; ++i) {
+        const SlotData *data = &board->slots[i];
+        out[len++] =
+            (unsigned char) ((data->phase + 1) | (data->owner + 1) << 4);
+    }
+    return len;
+}
+
+#ifdef LUNAR_TRACE
+char * EMSCRIPTEN_KEEPALIVE Glue_TraceJSON(void) {
+    /*
+     * Return the trace of the last `Glue_AIMove` as JSON, which the
+     * caller must free. Only tracing builds (`build.py --trace`) have
+     * this function.
+     */
+    return Trace_ToJSON();
+}
+#endif
+
+// Boards loaded with `Glue_LoadBoard`, which are never unloaded
+static LoadedBoard **loaded_boards = NULL;
+static int num_loaded_boards = 0;
+
+int EMSCRIPTEN_KEEPALIVE Glue_LoadBoard(
+    const char *text, char *error, int error_size
+) {
+    /*
+     * Load a board from the text of a board file (see boardfile.c) and
+     * return its index for `Glue_InitLoadedBoard`, or -1 with a message
+     * in `error`.
+     */
+    LoadedBoard *board = LoadedBoard_Parse(text, error, error_size);
+    if (!board) {
+        return -1;
+    }
+    loaded_boards = (LoadedBoard **) realloc(
+        loaded_boards, (num_loaded_boards + 1) * sizeof(LoadedBoard *)
+    );
+    loaded_boards[num_loaded_boards] = board;
+    return num_loaded_boards++;
+}
+
+void EMSCRIPTEN_KEEPALIVE Glue_InitLoadedBoard(
+    DisplayableBoard *board, int index
+) {
+    LoadedBoard_InitDisplayable(loaded_boards[index], board);
+}
+
+GameLog * EMSCRIPTEN_KEEPALIVE Glue_NewGameLog(
+    int board_id, unsigned seed, int cards_in_a_hand
+) {
+    /* `GameLog_New` with a seed that fits in a JavaScript number. */
+    return GameLog_New(board_id, seed, cards_in_a_hand);
+}
+
+int EMSCRIPTEN_KEEPALIVE Glue_ApplyWildcard(
+    GameBoard *board, int kind, int target_slot, unsigned seed,
+    int *out, int capacity
+) {
+    Random rng;
+    Random_Seed(&rng, seed);
+    return GameBoard_ApplyWildcardFlat(
+        board, (WildcardKind) kind, target_slot, &rng, out, capacity
+    );
 }
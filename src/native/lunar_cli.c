@@ -0,0 +1,983 @@
+/*
+ * Command line front end of the native build, see `build.py native`.
+ *
+ *     lunar_cli selfplay [--depth N] [--seed N] [--board NAME]
+ *                        [--samples N [--exact-layers N]]
+ *                        [--trace FILE [--trace-ply N]]
+ *                        [--snapshots FILE] [--logs PREFIX] [--step N]
+ *
+ * plays one game on every preset board (or only on board NAME): the AI
+ * (black) with search depth N against a player who plays random cards
+ * on random slots (white). Card draws come from a `Random` seeded with
+ * `--seed`, so a run is reproducible. This is also the workload that
+ * the profile-guided builds are trained on. `--samples` and
+ * `--exact-layers` set `AIOptions.chance_samples` and
+ * `exact_chance_layers`.
+ *
+ * With `--trace`, the AI searches are written to FILE in the Chrome
+ * Trace Event Format, with spans for search nodes down to the given
+ * ply (1 by default: every root move). Only the `trace` configuration
+ * is built with tracing. With `--snapshots`, the position after every
+ * move is appended to FILE as a `BoardSnapshot` whose `board_id` is the
+ * index of the preset board. With `--logs`, the game on each board is
+ * written as a `GameLog` to PREFIX<board>.log; every game then draws
+ * from its own random number generator, seeded with `--seed` plus the
+ * index of the board, so the games differ from those without logs.
+ * With `--step`, the AI searches are run through `AISearch_Step` N
+ * nodes at a time, which must come to the same moves as in one go.
+ *
+ *     lunar_cli scale [--depth N] [--seed N] [--max-slots N]
+ *                     [--order file|shuffled|local]
+ *
+ * measures `GameBoard_PutCard` and `AIMove` (with search depth N, 1 by
+ * default) on synthetic boards of growing size (see boardgen.c), to
+ * show how their cost grows with the number of slots and their degree.
+ * `--order` numbers the slots as they are generated (row by row, the
+ * default), at random (like a board drawn by hand), or at random and
+ * then renumbered by `Slots_LocalOrder`; the `bw` column is the
+ * largest difference between the IDs of two neighbors.
+ *
+ *     lunar_cli scan FILE [--restore]
+ *
+ * reads a file of snapshots in place (memory-mapped where possible) and
+ * sums up the positions in it. With `--restore`, every position is also
+ * loaded into a board of its preset.
+ *
+ *     lunar_cli replay [--no-ai] [--repeat N] FILE...
+ *
+ * plays the game logs (see gamelog.c), such as the ones the game lets
+ * players download, again: it checks that the random draws and the
+ * final score come out the same, searches every AI move again to time
+ * it and tell whether it still comes out the same (searches that the
+ * game cut short for time need not), and reports how fast the moves
+ * replay. With `--repeat`, the moves (but not the AI searches) are
+ * replayed N times for timing.
+ *
+ *     lunar_cli board FILE...
+ *
+ * checks board files (see boardfile.c), such as the ones the game can
+ * load for custom levels, and prints what they are like.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../backend/lunar_game.h"
+#include "preset_boards.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CARDS_IN_A_HAND 3
+
+static MoonPhase drawCard(Random *rng) {
+    return (MoonPhase) Random_Below(rng, MoonPhase_NumPhases);
+}
+
+static int randomEmptySlot(
+    const GameBoard *board, Random *rng, GameLog *log
+) {
+    /* Draw from `log` instead of `rng` if not NULL, logging it. */
+    int empty = 0;
+    for (int i = 0; i < board->num_slots; ++i) {
+        empty += board->slots[i].phase == MP_NULL;
+    }
+    int chosen = log ? GameLog_Below(log, empty) : Random_Below(rng, empty);
+    for (int i = 0; i < board->num_slots; ++i) {
+        if (board->slots[i].phase == MP_NULL && chosen-- == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void writeSnapshot(const GameBoard *board, int board_id, FILE *fp) {
+    if (!fp) {
+        return;
+    }
+    const size_t size = GameBoard_SnapshotSize(board, board_id);
+    void *data = malloc(size);
+    GameBoard_Snapshot(board, board_id, data);
+    fwrite(data, 1, size, fp);
+    free(data);
+}
+
+static MoonPhase dealCard(Random *rng, GameLog *log, Player player, int card) {
+    /* Draw from `log` instead of `rng` if not NULL, logging it. */
+    return log ? GameLog_Draw(log, player, card) : drawCard(rng);
+}
+
+static AIDecision *stepAIMove(
+    const GameBoard *board, MoonPhase *hand, int depth,
+    const AIOptions *options, long step, AIStats *out_stats
+) {
+    /* `AIMoveWithOptions`, `step` nodes at a time if it is positive. */
+    if (step <= 0) {
+        return AIMoveWithOptions(
+            board, hand, CARDS_IN_A_HAND, depth, options, out_stats
+        );
+    }
+    AISearch *search =
+        AISearch_Begin(board, hand, CARDS_IN_A_HAND, depth, options);
+    while (!AISearch_Step(search, step)) {
+    }
+    AIDecision *d = AISearch_Result(search, out_stats);
+    AISearch_Delete(search);
+    return d;
+}
+
+static void selfplayOne(
+    const PresetBoard *preset, int depth, const AIOptions *options,
+    long step, Random *rng, FILE *snapshots, GameLog *log
+) {
+    const int board_id = (int) (preset - preset_boards);
+    GameBoard *board = GameBoard_FromEdges(*preset->num_slots, preset->edges);
+    MoonPhase hand[CARDS_IN_A_HAND];
+    for (int i = 0; i < CARDS_IN_A_HAND; ++i) {
+        hand[i] = dealCard(rng, log, P_BLACK, i);
+    }
+    long nodes = 0;
+    const clock_t start = clock();
+    for (int turn = 0; turn < board->num_slots; ++turn) {
+        if (turn % 2 == 0) {
+            const MoonPhase phase = dealCard(rng, log, P_WHITE, 0);
+            const int slot_id = randomEmptySlot(board, rng, log);
+            if (log) {
+                GameLog_Play(log, P_WHITE, 0, slot_id);
+            }
+            PatternNode_DeleteChain(
+                GameBoard_PutCard(board, slot_id, phase, P_WHITE)
+            );
+            writeSnapshot(board, board_id, snapshots);
+            continue;
+        }
+        if (log) {
+            GameLog_AI(log, P_BLACK, depth, 1);
+        }
+        AIStats stats;
+        AIDecision *d =
+            stepAIMove(board, hand, depth, options, step, &stats);
+        nodes += stats.nodes;
+        if (log) {
+            GameLog_Play(log, P_BLACK, d->card_id, d->slot_id);
+        }
+        PatternNode_DeleteChain(GameBoard_PutCard(
+            board, d->slot_id, hand[d->card_id], P_BLACK
+        ));
+        hand[d->card_id] = dealCard(rng, log, P_BLACK, d->card_id);
+        free(d);
+        writeSnapshot(board, board_id, snapshots);
+    }
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf(
+        "%-20s white %3d black %3d  nodes %10ld  %8.3fs\n",
+        preset->name, board->white_stars + board->claimed[P_WHITE],
+        board->black_stars + board->claimed[P_BLACK], nodes, seconds
+    );
+    if (log) {
+        GameLog_End(log, board);
+    }
+    GameBoard_Delete(board);
+}
+
+static int writeLog(const GameLog *log, const char *prefix, const char *name) {
+    char *path = (char *) malloc(strlen(prefix) + strlen(name) + 5);
+    sprintf(path, "%s%s.log", prefix, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        free(path);
+        return 1;
+    }
+    char *text = GameLog_ToText(log);
+    fputs(text, fp);
+    free(text);
+    const int c = fclose(fp) ? 1 : 0;
+    free(path);
+    return c;
+}
+
+#ifdef LUNAR_TRACE
+static int writeTrace(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    char *json = Trace_ToJSON();
+    fputs(json, fp);
+    free(json);
+    return fclose(fp) ? 1 : 0;
+}
+#endif
+
+static int selfplay(int argc, char **argv) {
+    int depth = 4;
+    unsigned long seed = 1;
+    AIOptions options;
+    AIOptions_Init(&options);
+    long step = 0;
+    const char *only_board = NULL;
+    const char *trace_file = NULL;
+    int trace_ply = 1;
+    const char *snapshot_file = NULL;
+    const char *log_prefix = NULL;
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "--depth")) {
+            depth = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--seed")) {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--board")) {
+            only_board = argv[++i];
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--samples")) {
+            options.chance_samples = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--exact-layers")) {
+            options.exact_chance_layers = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--step")) {
+            step = atol(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--trace")) {
+            trace_file = argv[++i];
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--trace-ply")) {
+            trace_ply = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--snapshots")) {
+            snapshot_file = argv[++i];
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--logs")) {
+            log_prefix = argv[++i];
+        }
+        else {
+            fprintf(stderr, "selfplay: bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+#ifdef LUNAR_TRACE
+    if (trace_file) {
+        Trace_Start(trace_ply);
+    }
+#else
+    (void) trace_ply;
+    if (trace_file) {
+        fprintf(stderr, "selfplay: this build cannot trace\n");
+        return 2;
+    }
+#endif
+    FILE *snapshots = NULL;
+    if (snapshot_file && !(snapshots = fopen(snapshot_file, "wb"))) {
+        perror(snapshot_file);
+        return 1;
+    }
+    Random rng;
+    Random_Seed(&rng, seed);
+    bool found = false;
+    const clock_t start = clock();
+    for (int i = 0; i < NUM_PRESET_BOARDS; ++i) {
+        if (only_board && strcmp(only_board, preset_boards[i].name)) {
+            continue;
+        }
+        found = true;
+        GameLog *log = log_prefix
+            ? GameLog_New(i, seed + i, CARDS_IN_A_HAND) : NULL;
+        selfplayOne(
+            &preset_boards[i], depth, &options, step, &rng, snapshots, log
+        );
+        if (log) {
+            const int c = writeLog(log, log_prefix, preset_boards[i].name);
+            GameLog_Delete(log);
+            if (c) {
+                return c;
+            }
+        }
+    }
+    if (snapshots && fclose(snapshots)) {
+        perror(snapshot_file);
+        return 1;
+    }
+    if (!found) {
+        fprintf(stderr, "selfplay: no board named '%s'\n", only_board);
+        return 2;
+    }
+    printf("total %.3fs\n", (double) (clock() - start) / CLOCKS_PER_SEC);
+#ifdef LUNAR_TRACE
+    if (trace_file) {
+        Trace_Stop();
+        return writeTrace(trace_file);
+    }
+#endif
+    return 0;
+}
+
+typedef struct ScaleCase {
+    BoardShape shape;
+    int width;
+    int height;
+} ScaleCase;
+
+static const char *const shape_names[BoardShape_NumShapes] = {
+    "grid", "torus", "planar", "cliques",
+};
+
+typedef enum SlotOrder {
+    SO_FILE,
+    SO_SHUFFLED,
+    SO_LOCAL,
+    SlotOrder_NumOrders,
+} SlotOrder;
+
+static const char *const order_names[SlotOrder_NumOrders] = {
+    "file", "shuffled", "local",
+};
+
+static const ScaleCase scale_cases[] = {
+    {BS_GRID, 4, 4}, {BS_GRID, 8, 8}, {BS_GRID, 16, 16}, {BS_GRID, 32, 32},
+    {BS_TORUS, 4, 4}, {BS_TORUS, 8, 8}, {BS_TORUS, 16, 16},
+    {BS_TORUS, 32, 32},
+    {BS_PLANAR, 4, 4}, {BS_PLANAR, 8, 8}, {BS_PLANAR, 16, 16},
+    {BS_PLANAR, 32, 32},
+    // Groups of one phase each, see `fillBoard`. The number of lunar
+    // cycle paths grows exponentially with the number of groups, and
+    // GameBoard_PutCard has to go through all of them, so these are
+    // kept small.
+    {BS_CLIQUES, 2, 8}, {BS_CLIQUES, 3, 8}, {BS_CLIQUES, 4, 8},
+    {BS_CLIQUES, 5, 8}, {BS_CLIQUES, 2, 12}, {BS_CLIQUES, 2, 16},
+};
+
+#define NUM_SCALE_CASES ((int) (sizeof(scale_cases) / sizeof(scale_cases[0])))
+
+static double fillBoard(
+    GameBoard *board, const ScaleCase *c, const int *gen_ids, int count,
+    Random *rng, double *out_max_seconds
+) {
+    /*
+     * Put cards on `count` random empty slots of `board` and return how
+     * long that took in total. Cliques get the phase of their group,
+     * other boards random phases. `gen_ids` has the ID each slot had
+     * when it was generated.
+     */
+    double total = 0;
+    *out_max_seconds = 0;
+    for (int k = 0; k < count; ++k) {
+        const int slot_id = randomEmptySlot(board, rng, NULL);
+        const MoonPhase phase = c->shape == BS_CLIQUES
+            ? (MoonPhase) (gen_ids[slot_id] / c->width % MoonPhase_NumPhases)
+            : drawCard(rng);
+        const clock_t start = clock();
+        PatternNode_DeleteChain(GameBoard_PutCard(
+            board, slot_id, phase, k % 2 ? P_BLACK : P_WHITE
+        ));
+        const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        total += seconds;
+        if (seconds > *out_max_seconds) {
+            *out_max_seconds = seconds;
+        }
+    }
+    return total;
+}
+
+static int *orderSlots(
+    int num_slots, int **edges, SlotOrder order, Random *rng
+) {
+    /*
+     * Renumber the slots of `*edges` as `order` says and return the ID
+     * each slot had before, which the caller must free.
+     */
+    int *new_ids = (int *) malloc(num_slots * sizeof(int));
+    for (int i = 0; i < num_slots; ++i) {
+        new_ids[i] = i;
+    }
+    if (order != SO_FILE) {
+        for (int i = num_slots - 1; i > 0; --i) {
+            const int j = Random_Below(rng, i + 1);
+            const int id = new_ids[i];
+            new_ids[i] = new_ids[j];
+            new_ids[j] = id;
+        }
+        int *shuffled = Edges_Relabel(*edges, new_ids);
+        free(*edges);
+        *edges = shuffled;
+    }
+    if (order == SO_LOCAL) {
+        int *local_ids = Slots_LocalOrder(num_slots, *edges);
+        int *local = Edges_Relabel(*edges, local_ids);
+        free(*edges);
+        *edges = local;
+        for (int i = 0; i < num_slots; ++i) {
+            new_ids[i] = local_ids[new_ids[i]];
+        }
+        free(local_ids);
+    }
+    int *gen_ids = (int *) malloc(num_slots * sizeof(int));
+    for (int i = 0; i < num_slots; ++i) {
+        gen_ids[new_ids[i]] = i;
+    }
+    free(new_ids);
+    return gen_ids;
+}
+
+static void scaleOne(
+    const ScaleCase *c, int depth, SlotOrder order, Random *rng,
+    Random *order_rng  /* Kept apart so that every order plays alike */
+) {
+    int num_slots;
+    int *edges = BoardGen_Edges(
+        c->shape, c->width, c->height, rng, &num_slots
+    );
+    int num_edges = 0;
+    while (edges[num_edges * 2] != -1) {
+        ++num_edges;
+    }
+    int *gen_ids = orderSlots(num_slots, &edges, order, order_rng);
+    // PutCard on every slot of an empty board
+    GameBoard *board = GameBoard_FromEdges(num_slots, edges);
+    double put_max;
+    const double put_total =
+        fillBoard(board, c, gen_ids, num_slots, rng, &put_max);
+    GameBoard_Delete(board);
+    // AIMove on a half filled board
+    board = GameBoard_FromEdges(num_slots, edges);
+    double unused;
+    fillBoard(board, c, gen_ids, num_slots / 2, rng, &unused);
+    MoonPhase hand[CARDS_IN_A_HAND];
+    for (int i = 0; i < CARDS_IN_A_HAND; ++i) {
+        hand[i] = drawCard(rng);
+    }
+    AIOptions options;
+    AIOptions_Init(&options);
+    AIStats stats;
+    const clock_t start = clock();
+    free(AIMoveWithOptions(
+        board, hand, CARDS_IN_A_HAND, depth, &options, &stats
+    ));
+    const double ai_seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    GameBoard_Delete(board);
+    printf(
+        "%-8s %6d %7.2f %6d %12.2f %12.2f %10.2f %10ld\n",
+        shape_names[c->shape], num_slots, 2.0 * num_edges / num_slots,
+        Edges_Bandwidth(edges, NULL), put_total * 1e6 / num_slots,
+        put_max * 1e6, ai_seconds * 1e3, stats.nodes
+    );
+    free(gen_ids);
+    free(edges);
+    fflush(stdout);
+}
+
+static int scale(int argc, char **argv) {
+    int depth = 1;
+    unsigned long seed = 1;
+    int max_slots = 1 << 20;
+    int order = SO_FILE;
+    for (int i = 0; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "--depth")) {
+            depth = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--seed")) {
+            seed = strtoul(argv[++i], NULL, 10);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--max-slots")) {
+            max_slots = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--order")) {
+            ++i;
+            order = 0;
+            while (
+                order < SlotOrder_NumOrders
+                && strcmp(argv[i], order_names[order])
+            ) {
+                ++order;
+            }
+            if (order == SlotOrder_NumOrders) {
+                fprintf(stderr, "scale: unknown order '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        else {
+            fprintf(stderr, "scale: bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+    Random rng, order_rng;
+    Random_Seed(&rng, seed);
+    Random_Seed(&order_rng, seed);
+    printf(
+        "%-8s %6s %7s %6s %12s %12s %10s %10s\n", "shape", "slots",
+        "degree", "bw", "put avg us", "put max us", "ai ms", "ai nodes"
+    );
+    for (int i = 0; i < NUM_SCALE_CASES; ++i) {
+        const ScaleCase *c = &scale_cases[i];
+        if (c->width * c->height <= max_slots) {
+            scaleOne(c, depth, (SlotOrder) order, &rng, &order_rng);
+        }
+    }
+    return 0;
+}
+
+static const void *mapFile(const char *path, size_t *out_size) {
+    /* Return the contents of `path` (NULL on errors); see `unmapFile`. */
+#if HAVE_MMAP
+    const int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        return NULL;
+    }
+    *out_size = (size_t) st.st_size;
+    void *data = *out_size
+        ? mmap(NULL, *out_size, PROT_READ, MAP_PRIVATE, fd, 0)
+        : malloc(1);
+    close(fd);
+    return data == MAP_FAILED ? NULL : data;
+#else
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    char *data = (char *) malloc(capacity);
+    *out_size = 0;
+    size_t n;
+    while ((n = fread(data + *out_size, 1, capacity - *out_size, fp)) > 0) {
+        *out_size += n;
+        if (*out_size == capacity) {
+            capacity *= 2;
+            data = (char *) realloc(data, capacity);
+        }
+    }
+    fclose(fp);
+    return data;
+#endif
+}
+
+static void unmapFile(const void *data, size_t size) {
+#if HAVE_MMAP
+    if (size) {
+        munmap((void *) data, size);
+        return;
+    }
+#endif
+    free((void *) data);
+}
+
+static int scan(int argc, char **argv) {
+    const char *path = NULL;
+    bool restore = false;
+    for (int i = 0; i < argc; ++i) {
+        if (!strcmp(argv[i], "--restore")) {
+            restore = true;
+        }
+        else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        }
+        else {
+            fprintf(stderr, "scan: bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "scan: no file given\n");
+        return 2;
+    }
+    size_t size;
+    const char *data = (const char *) mapFile(path, &size);
+    if (!data) {
+        perror(path);
+        return 1;
+    }
+    // Boards that positions of each preset are restored into
+    GameBoard *boards[NUM_PRESET_BOARDS] = {NULL};
+    long positions[NUM_PRESET_BOARDS + 1] = {0};
+    long num_positions = 0, filled = 0, lead = 0;
+    size_t offset = 0;
+    const clock_t start = clock();
+    while (offset < size) {
+        const BoardSnapshot *snap =
+            BoardSnapshot_Check(data + offset, size - offset);
+        if (!snap) {
+            fprintf(stderr, "scan: bad snapshot at byte %zu\n", offset);
+            break;
+        }
+        offset += snap->size;
+        const int id = snap->board_id;
+        const bool preset = id >= 0 && id < NUM_PRESET_BOARDS
+            && snap->num_slots == *preset_boards[id].num_slots;
+        ++positions[preset ? id : NUM_PRESET_BOARDS];
+        ++num_positions;
+        const int8_t *phases = BoardSnapshot_Phases(snap);
+        const int8_t *owners = BoardSnapshot_Owners(snap);
+        for (int i = 0; i < snap->num_slots; ++i) {
+            filled += phases[i] != MP_NULL;
+            lead += (owners[i] == P_BLACK) - (owners[i] == P_WHITE);
+        }
+        lead += snap->black_stars - snap->white_stars;
+        if (restore && preset) {
+            if (!boards[id]) {
+                boards[id] = GameBoard_FromEdges(
+                    *preset_boards[id].num_slots, preset_boards[id].edges
+                );
+            }
+            GameBoard_LoadSnapshot(boards[id], snap);
+        }
+        else if (restore && snap->board_id < 0) {
+            GameBoard_Delete(BoardSnapshot_NewBoard(snap));
+        }
+    }
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    for (int i = 0; i <= NUM_PRESET_BOARDS; ++i) {
+        if (positions[i]) {
+            printf(
+                "%-20s %10ld\n",
+                i < NUM_PRESET_BOARDS ? preset_boards[i].name : "(other)",
+                positions[i]
+            );
+        }
+        if (i < NUM_PRESET_BOARDS && boards[i]) {
+            GameBoard_Delete(boards[i]);
+        }
+    }
+    printf(
+        "positions %ld  bytes %zu  filled %.2f  black lead %.2f\n",
+        num_positions, offset, num_positions ? (double) filled / num_positions
+        : 0.0, num_positions ? (double) lead / num_positions : 0.0
+    );
+    printf(
+        "%.3fs  %.0f positions/s\n", seconds,
+        seconds > 0 ? num_positions / seconds : 0.0
+    );
+    unmapFile(data, size);
+    return offset == size ? 0 : 1;
+}
+
+static char *readText(const char *path) {
+    /* Return the contents of `path` (NULL on errors); free it. */
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    size_t len = 0, capacity = 4096;
+    char *text = (char *) malloc(capacity);
+    size_t n;
+    while ((n = fread(text + len, 1, capacity - len - 1, fp)) > 0) {
+        len += n;
+        if (len + 1 == capacity) {
+            capacity *= 2;
+            text = (char *) realloc(text, capacity);
+        }
+    }
+    fclose(fp);
+    text[len] = '\0';
+    return text;
+}
+
+#define MAX_CARDS_IN_A_HAND 16
+
+typedef struct ReplayStats {
+    long moves;
+    long ai_moves;
+    long ai_differs;  // AI moves that came out differently
+    double move_seconds;
+    double ai_seconds;
+    double ai_max_seconds;
+} ReplayStats;
+
+static AIDecision *replayAI(
+    const GameBoard *board, MoonPhase *hand, int num_cards, int depth,
+    int top_k, uint32_t seed
+) {
+    /* Make the same choice as `Glue_AIMove` with these arguments. */
+    if (top_k <= 1) {
+        return AIMove(board, hand, num_cards, depth);
+    }
+    AIOptions options;
+    AIOptions_Init(&options);
+    int num_moves;
+    AIRankedMove *ranking = AIRankMoves(
+        board, hand, num_cards, depth, top_k, &options, &num_moves, NULL
+    );
+    Random rng;
+    Random_Seed(&rng, seed);
+    AIDecision *d = (AIDecision *) malloc(sizeof(AIDecision));
+    *d = ranking[Random_Below(
+        &rng, num_moves < top_k ? num_moves : top_k
+    )].decision;
+    free(ranking);
+    return d;
+}
+
+static const char *replayOnce(
+    const GameLog *log, bool run_ai, ReplayStats *stats, int *out_event
+) {
+    /* Return what went wrong at event `*out_event`, or NULL. */
+    const PresetBoard *preset = &preset_boards[log->board_id];
+    const int n = *preset->num_slots;
+    GameBoard *board = GameBoard_FromEdges(n, preset->edges);
+    Random rng;
+    Random_Seed(&rng, log->seed);
+    MoonPhase hands[2][MAX_CARDS_IN_A_HAND];
+    for (int p = 0; p < 2; ++p) {
+        for (int i = 0; i < log->cards_in_a_hand; ++i) {
+            hands[p][i] = MP_NULL;
+        }
+    }
+    int ai_depth[2] = {0, 0}, ai_top_k[2];
+    uint32_t ai_seed[2];
+    const char *error = NULL;
+    const clock_t start = clock();
+    double ai_seconds = 0;
+    int i;
+    for (i = 0; !error && i < log->num_events; ++i) {
+        const int *args = log->events[i].args;
+        const GameEventKind kind = log->events[i].kind;
+        const int p = args[0];
+        if (
+            kind != GE_RANDOM && kind != GE_END && p != P_WHITE
+            && p != P_BLACK
+        ) {
+            error = "bad player";
+            break;
+        }
+        switch (kind) {
+        case GE_DRAW:
+        case GE_DEAL:
+            if (
+                args[1] < 0 || args[1] >= log->cards_in_a_hand
+                || args[2] < 0 || args[2] >= MoonPhase_NumPhases
+            ) {
+                error = "bad card";
+            }
+            else if (
+                kind == GE_DRAW
+                && Random_Below(&rng, MoonPhase_NumPhases) != args[2]
+            ) {
+                error = "a different card was drawn";
+            }
+            else {
+                hands[p][args[1]] = (MoonPhase) args[2];
+            }
+            break;
+        case GE_AI:
+            ai_depth[p] = args[1];
+            ai_top_k[p] = args[2];
+            ai_seed[p] = Random_Next(&rng);
+            break;
+        case GE_RANDOM:
+            if (args[0] < 1 || Random_Below(&rng, args[0]) != args[1]) {
+                error = "a different random number was drawn";
+            }
+            break;
+        case GE_WILDCARD: {
+            Random wildcard_rng;
+            Random_Seed(&wildcard_rng, Random_Next(&rng));
+            if (args[1] < 0 || args[1] >= WildcardKind_NumKinds) {
+                error = "bad wildcard";
+                break;
+            }
+            GameBoard_ApplyWildcard(
+                board, (WildcardKind) args[1], args[2], &wildcard_rng,
+                NULL, NULL
+            );
+            break;
+        }
+        case GE_PLAY: {
+            const int card = args[1], slot = args[2];
+            if (
+                card < 0 || card >= log->cards_in_a_hand
+                || hands[p][card] == MP_NULL
+                || slot < 0 || slot >= n || board->slots[slot].phase != MP_NULL
+            ) {
+                error = "bad move";
+                break;
+            }
+            if (ai_depth[p] && run_ai) {
+                const clock_t ai_start = clock();
+                AIDecision *d = replayAI(
+                    board, hands[p], log->cards_in_a_hand, ai_depth[p],
+                    ai_top_k[p], ai_seed[p]
+                );
+                const double seconds =
+                    (double) (clock() - ai_start) / CLOCKS_PER_SEC;
+                ai_seconds += seconds;
+                if (seconds > stats->ai_max_seconds) {
+                    stats->ai_max_seconds = seconds;
+                }
+                ++stats->ai_moves;
+                stats->ai_differs += d->card_id != card || d->slot_id != slot;
+                free(d);
+            }
+            ai_depth[p] = 0;
+            PatternNode_DeleteChain(
+                GameBoard_PutCard(board, slot, hands[p][card], (Player) p)
+            );
+            hands[p][card] = MP_NULL;
+            ++stats->moves;
+            break;
+        }
+        case GE_END:
+            if (
+                board->white_stars != args[0] || board->black_stars != args[1]
+                || board->claimed[P_WHITE] != args[2]
+                || board->claimed[P_BLACK] != args[3]
+            ) {
+                error = "the score is different";
+            }
+            break;
+        default:
+            error = "bad event";
+            break;
+        }
+    }
+    stats->ai_seconds += ai_seconds;
+    stats->move_seconds +=
+        (double) (clock() - start) / CLOCKS_PER_SEC - ai_seconds;
+    GameBoard_Delete(board);
+    *out_event = i;
+    return error;
+}
+
+static int replay(int argc, char **argv) {
+    bool run_ai = true;
+    int repeat = 1;
+    int num_files = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (!strcmp(argv[i], "--no-ai")) {
+            run_ai = false;
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--repeat")) {
+            repeat = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "replay: bad argument '%s'\n", argv[i]);
+            return 2;
+        }
+        else {
+            argv[num_files++] = argv[i];
+        }
+    }
+    ReplayStats stats = {0};
+    int failed = 0;
+    for (int f = 0; f < num_files; ++f) {
+        char *text = readText(argv[f]);
+        GameLog *log = text ? GameLog_FromText(text) : NULL;
+        free(text);
+        if (
+            !log || log->board_id < 0 || log->board_id >= NUM_PRESET_BOARDS
+            || log->cards_in_a_hand < 1
+            || log->cards_in_a_hand > MAX_CARDS_IN_A_HAND
+        ) {
+            fprintf(stderr, "%s: not a game log of a preset board\n", argv[f]);
+            ++failed;
+            if (log) {
+                GameLog_Delete(log);
+            }
+            continue;
+        }
+        const long ai_differs = stats.ai_differs;
+        for (int r = 0; r < repeat; ++r) {
+            int event;
+            const char *error =
+                replayOnce(log, run_ai && r == 0, &stats, &event);
+            if (error) {
+                printf("%s: event %d: %s\n", argv[f], event + 1, error);
+                ++failed;
+                break;
+            }
+        }
+        if (stats.ai_differs > ai_differs) {
+            printf(
+                "%s: %ld AI moves came out differently\n", argv[f],
+                stats.ai_differs - ai_differs
+            );
+        }
+        GameLog_Delete(log);
+    }
+    printf(
+        "games %d  failed %d  moves %ld  %.0f moves/s\n", num_files, failed,
+        stats.moves, stats.move_seconds > 0
+        ? stats.moves / stats.move_seconds : 0.0
+    );
+    if (run_ai) {
+        printf(
+            "AI moves %ld  different %ld  total %.3fs  max %.3fs\n",
+            stats.ai_moves, stats.ai_differs, stats.ai_seconds,
+            stats.ai_max_seconds
+        );
+    }
+    return failed ? 1 : 0;
+}
+
+static int board(int argc, char **argv) {
+    int failed = 0;
+    for (int i = 0; i < argc; ++i) {
+        char *text = readText(argv[i]);
+        if (!text) {
+            fprintf(stderr, "%s: cannot read\n", argv[i]);
+            ++failed;
+            continue;
+        }
+        char error[256];
+        LoadedBoard *loaded = LoadedBoard_Parse(text, error, sizeof(error));
+        free(text);
+        if (!loaded) {
+            fprintf(stderr, "%s: %s\n", argv[i], error);
+            ++failed;
+            continue;
+        }
+        printf(
+            "%s: %s  slots %d  edges %d  max degree %d  components %d"
+            "  display %dx%d%s\n",
+            argv[i], loaded->name, loaded->layout->num_slots,
+            loaded->num_edges, loaded->max_degree, loaded->num_components,
+            loaded->x_len, loaded->y_len,
+            loaded->file_ids ? "  renumbered" : ""
+        );
+        LoadedBoard_Delete(loaded);
+    }
+    return failed ? 1 : 0;
+}
+
+static void usage(const char *program) {
+    fprintf(
+        stderr,
+        "usage: %s selfplay [--depth N] [--seed N] [--board NAME]\n"
+        "                   [--samples N [--exact-layers N]]\n"
+        "                   [--trace FILE [--trace-ply N]]\n"
+        "                   [--snapshots FILE] [--logs PREFIX] [--step N]\n"
+        "       %s scale [--depth N] [--seed N] [--max-slots N]\n"
+        "                [--order file|shuffled|local]\n"
+        "       %s scan FILE [--restore]\n"
+        "       %s replay [--no-ai] [--repeat N] FILE...\n"
+        "       %s board FILE...\n",
+        program, program, program, program, program
+    );
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && !strcmp(argv[1], "selfplay")) {
+        return selfplay(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "scale")) {
+        return scale(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "scan")) {
+        return scan(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "replay")) {
+        return replay(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && !strcmp(argv[1], "board")) {
+        return board(argc - 2, argv + 2);
+    }
+    usage(argv[0]);
+    return 2;
+}
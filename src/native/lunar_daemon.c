@@ -0,0 +1,861 @@
+/*
+ * AI service of the native build, see `build.py native`.
+ *
+ *     lunar_daemon [--workers N] [--socket PATH]
+ *
+ * hosts any number of games at once and answers requests about them.
+ * Requests are JSON objects, one per line, read from stdin, or from
+ * every connection to the Unix socket PATH if given; replies are
+ * written back the same way. Every request may have an "id" of any
+ * scalar JSON value, which its reply repeats. "game" is a name chosen
+ * by the client.
+ *
+ *     {"op": "new", "game": G, "board": NAME}
+ *         Start game G on the preset board NAME. All the games on a
+ *         board share its edges.
+ *     {"op": "put", "game": G, "slot": S, "phase": P, "player": "white"}
+ *         Play card P on slot S for "white" or "black".
+ *     {"op": "ai", "game": G, "hand": [P, ...], "depth": D,
+ *      "deadline_ms": T, "samples": N}
+ *         Queue an AI search of depth D (4 by default) for black, the
+ *         side the AI always plays, with the cards of the hand; there
+ *         is no search for white. Searches run on a fixed pool of N
+ *         worker threads (one per CPU by default), so replies to "ai"
+ *         come back when they are done, not in request order. With a
+ *         deadline, counted from when the request is read, the search
+ *         is aborted at T ms and the best move found so far is returned
+ *         with "timed_out": true. "samples" sets
+ *         `AIOptions.chance_samples`.
+ *     {"op": "delete", "game": G}
+ *     {"op": "stats"}
+ *         Number of games, queue depth and worker pool counters.
+ *
+ * Replies have "ok": true, or "ok": false and an "error" message.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../backend/lunar_game.h"
+#include "preset_boards.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FIELDS 16
+#define MAX_KEY_LEN 31
+#define MAX_STRING_LEN 127
+#define MAX_ARRAY_LEN 16
+#define MAX_ID_LEN 64
+#define MAX_HAND 8
+#define MAX_DEPTH 12
+#define MAX_REPLY_LEN 512
+// How often the watchdog checks the deadlines of running searches
+#define WATCHDOG_TICK_MS 2
+
+static double nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Requests */
+
+typedef enum ValueKind {
+    VK_STRING,
+    VK_NUMBER,
+    VK_ARRAY,  // Of numbers
+    VK_OTHER,  // true, false or null
+} ValueKind;
+
+typedef struct Field {
+    char key[MAX_KEY_LEN + 1];
+    ValueKind kind;
+    char string[MAX_STRING_LEN + 1];
+    double number;
+    double array[MAX_ARRAY_LEN];
+    int array_len;
+    // The value as it appears in the request
+    const char *raw;
+    int raw_len;
+} Field;
+
+typedef struct Request {
+    Field fields[MAX_FIELDS];
+    int num_fields;
+} Request;
+
+static void skipSpace(const char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n') {
+        ++*p;
+    }
+}
+
+static const char *parseString(const char **p, char *out, int capacity) {
+    /* Parse a string without \u escapes; return an error or NULL. */
+    if (**p != '"') {
+        return "expected a string";
+    }
+    ++*p;
+    int len = 0;
+    for (;;) {
+        char c = *(*p)++;
+        if (c == '"') {
+            break;
+        }
+        if (c == '\0' || c == '\n') {
+            return "unterminated string";
+        }
+        if (c == '\\') {
+            c = *(*p)++;
+            const char *escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+            const char *e = c ? strchr(escapes, c) : NULL;
+            if (!e || (e - escapes) % 2) {
+                return "unsupported escape in string";
+            }
+            c = e[1];
+        }
+        if (len == capacity) {
+            return "string too long";
+        }
+        out[len++] = c;
+    }
+    out[len] = '\0';
+    return NULL;
+}
+
+static const char *parseNumber(const char **p, double *out) {
+    char *end;
+    *out = strtod(*p, &end);
+    if (end == *p) {
+        return "expected a value";
+    }
+    *p = end;
+    return NULL;
+}
+
+static const char *parseValue(const char **p, Field *field) {
+    field->raw = *p;
+    const char *error = NULL;
+    if (**p == '"') {
+        field->kind = VK_STRING;
+        error = parseString(p, field->string, MAX_STRING_LEN);
+    }
+    else if (**p == '[') {
+        field->kind = VK_ARRAY;
+        field->array_len = 0;
+        ++*p;
+        skipSpace(p);
+        while (!error && **p != ']') {
+            if (field->array_len == MAX_ARRAY_LEN) {
+                return "array too long";
+            }
+            error = parseNumber(p, &field->array[field->array_len++]);
+            skipSpace(p);
+            if (!error && **p != ']') {
+                // Never step over the end of the line
+                if (**p != ',') {
+                    return "expected ',' or ']'";
+                }
+                ++*p;
+            }
+            skipSpace(p);
+        }
+        if (error) {
+            return error;
+        }
+        ++*p;
+    }
+    else if (**p == '{') {
+        return "nested objects are not supported";
+    }
+    else {
+        static const char *const words[] = {"true", "false", "null"};
+        for (int i = 0; i < 3; ++i) {
+            if (!strncmp(*p, words[i], strlen(words[i]))) {
+                field->kind = VK_OTHER;
+                *p += strlen(words[i]);
+                field->raw_len = (int) (*p - field->raw);
+                return NULL;
+            }
+        }
+        field->kind = VK_NUMBER;
+        error = parseNumber(p, &field->number);
+    }
+    field->raw_len = (int) (*p - field->raw);
+    return error;
+}
+
+static const char *parseRequest(const char *line, Request *req) {
+    /* Parse a flat JSON object; return an error or NULL. */
+    const char *p = line;
+    req->num_fields = 0;
+    skipSpace(&p);
+    if (*p++ != '{') {
+        return "expected an object";
+    }
+    skipSpace(&p);
+    while (*p != '}') {
+        if (req->num_fields == MAX_FIELDS) {
+            return "too many fields";
+        }
+        Field *field = &req->fields[req->num_fields++];
+        const char *error = parseString(&p, field->key, MAX_KEY_LEN);
+        if (error) {
+            return error;
+        }
+        skipSpace(&p);
+        if (*p++ != ':') {
+            return "expected ':'";
+        }
+        skipSpace(&p);
+        error = parseValue(&p, field);
+        if (error) {
+            return error;
+        }
+        skipSpace(&p);
+        if (*p == ',') {
+            ++p;
+            skipSpace(&p);
+        }
+        else if (*p != '}') {
+            return "expected ',' or '}'";
+        }
+    }
+    ++p;
+    skipSpace(&p);
+    return *p ? "trailing characters after the object" : NULL;
+}
+
+static const Field *findField(const Request *req, const char *key) {
+    for (int i = 0; i < req->num_fields; ++i) {
+        if (!strcmp(req->fields[i].key, key)) {
+            return &req->fields[i];
+        }
+    }
+    return NULL;
+}
+
+static const char *stringField(const Request *req, const char *key) {
+    const Field *field = findField(req, key);
+    return field && field->kind == VK_STRING ? field->string : NULL;
+}
+
+static bool intField(const Request *req, const char *key, int *out) {
+    /* Leave `out` alone and return false if there is no such integer. */
+    const Field *field = findField(req, key);
+    if (
+        !field || field->kind != VK_NUMBER
+        || field->number != (int) field->number
+    ) {
+        return false;
+    }
+    *out = (int) field->number;
+    return true;
+}
+
+/* Connections */
+
+typedef struct Connection {
+    FILE *in;
+    int out_fd;
+    pthread_mutex_t lock;  // For writing and `refs`
+    int refs;  // The reader plus one per queued or running search
+} Connection;
+
+static Connection *Connection_New(FILE *in, int out_fd) {
+    Connection *conn = (Connection *) malloc(sizeof(Connection));
+    conn->in = in;
+    conn->out_fd = out_fd;
+    pthread_mutex_init(&conn->lock, NULL);
+    conn->refs = 1;
+    return conn;
+}
+
+static void connectionRetain(Connection *conn) {
+    pthread_mutex_lock(&conn->lock);
+    ++conn->refs;
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void connectionRelease(Connection *conn) {
+    pthread_mutex_lock(&conn->lock);
+    const int refs = --conn->refs;
+    pthread_mutex_unlock(&conn->lock);
+    if (refs == 0) {
+        fclose(conn->in);
+        pthread_mutex_destroy(&conn->lock);
+        free(conn);
+    }
+}
+
+static void reply(Connection *conn, const char *id, const char *format, ...) {
+    /* Write `{"id": id, <format>}` as a line; no "id" if `id` is "". */
+    char line[MAX_REPLY_LEN];
+    int len = id[0]
+        ? snprintf(line, sizeof(line), "{\"id\":%s,", id)
+        : snprintf(line, sizeof(line), "{");
+    va_list ap;
+    va_start(ap, format);
+    len += vsnprintf(line + len, sizeof(line) - len - 2, format, ap);
+    va_end(ap);
+    if (len > (int) sizeof(line) - 3) {
+        len = (int) sizeof(line) - 3;
+    }
+    line[len++] = '}';
+    line[len++] = '\n';
+    pthread_mutex_lock(&conn->lock);
+    for (int done = 0; done < len; ) {
+        const ssize_t n = write(conn->out_fd, line + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;  // The client is gone
+        }
+        done += (int) n;
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void replyError(Connection *conn, const char *id, const char *error) {
+    reply(conn, id, "\"ok\":false,\"error\":\"%s\"", error);
+}
+
+/* Games */
+
+typedef struct Game {
+    char *name;
+    GameBoard *board;
+    pthread_rwlock_t lock;  // Searches read the board, "put" writes it
+    int refs;  // Guarded by `games_lock`
+} Game;
+
+// One board per preset that owns the edges all its games share
+static GameBoard *layouts[NUM_PRESET_BOARDS];
+
+static HashMap *games;  // Name to `Game`
+static pthread_mutex_t games_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Hash hashName(void *key, void *meta) {
+    Hash h = 14695981039346656037ull;
+    for (const unsigned char *c = (const unsigned char *) key; *c; ++c) {
+        h = (h ^ *c) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool nameEqual(void *key1, void *key2, void *meta) {
+    return !strcmp((const char *) key1, (const char *) key2);
+}
+
+static Game *acquireGame(const char *name) {
+    /* Return NULL if there is no game `name`. */
+    pthread_mutex_lock(&games_lock);
+    Game *game = (Game *) HashMap_GetOr(games, (void *) name, NULL);
+    if (game) {
+        ++game->refs;
+    }
+    pthread_mutex_unlock(&games_lock);
+    return game;
+}
+
+static void releaseGame(Game *game) {
+    pthread_mutex_lock(&games_lock);
+    const int refs = --game->refs;
+    pthread_mutex_unlock(&games_lock);
+    if (refs == 0) {
+        GameBoard_Delete(game->board);
+        pthread_rwlock_destroy(&game->lock);
+        free(game->name);
+        free(game);
+    }
+}
+
+/* Worker pool */
+
+typedef struct Job {
+    Connection *conn;
+    char id[MAX_ID_LEN + 1];
+    Game *game;
+    MoonPhase hand[MAX_HAND];
+    int hand_len;
+    int depth;
+    AIOptions options;
+    volatile int abort;
+    double received;  // In ms, see `nowMs`
+    double deadline;  // 0 if none
+    double started;
+    struct Job *next;
+} Job;
+
+typedef struct Pool {
+    pthread_mutex_t lock;
+    pthread_cond_t job_queued;
+    pthread_cond_t idle;  // Nothing queued or running
+    Job *head;
+    Job *tail;
+    int queued;
+    int max_queued;
+    int num_workers;
+    Job **running;  // The job of every worker, or NULL
+    int num_running;
+    long done;
+    long timed_out;
+    double total_wait_ms;
+    double total_search_ms;
+} Pool;
+
+static Pool pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+};
+
+static void poolSubmit(Job *job) {
+    pthread_mutex_lock(&pool.lock);
+    job->next = NULL;
+    if (pool.tail) {
+        pool.tail->next = job;
+    }
+    else {
+        pool.head = job;
+    }
+    pool.tail = job;
+    if (++pool.queued > pool.max_queued) {
+        pool.max_queued = pool.queued;
+    }
+    pthread_cond_signal(&pool.job_queued);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void poolWaitIdle(void) {
+    pthread_mutex_lock(&pool.lock);
+    while (pool.queued || pool.num_running) {
+        pthread_cond_wait(&pool.idle, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static bool runJob(Job *job) {
+    /* Search and reply; return whether the deadline was missed. */
+    const double start = job->started = nowMs();
+    const bool expired = job->deadline && start >= job->deadline;
+    GameBoard *board = job->game->board;
+    pthread_rwlock_rdlock(&job->game->lock);
+    int empty = 0;
+    for (int i = 0; i < board->num_slots; ++i) {
+        empty += board->slots[i].phase == MP_NULL;
+    }
+    if (empty == 0) {
+        pthread_rwlock_unlock(&job->game->lock);
+        replyError(job->conn, job->id, "the board is full");
+        return false;
+    }
+    AIStats stats = {0};
+    AIDecision *d = expired ? NULL : AIMoveWithOptions(
+        board, job->hand, job->hand_len, job->depth, &job->options, &stats
+    );
+    if (!d) {
+        // Out of time before any root move was searched in full; a
+        // depth 1 search takes next to no time
+        AIOptions options;
+        AIOptions_Init(&options);
+        d = AIMoveWithOptions(
+            board, job->hand, job->hand_len, 1, &options, NULL
+        );
+    }
+    pthread_rwlock_unlock(&job->game->lock);
+    const double searched = nowMs() - start;
+    const bool timed_out = expired || job->abort;
+    reply(
+        job->conn, job->id,
+        "\"ok\":true,\"card\":%d,\"slot\":%d,\"timed_out\":%s,"
+        "\"nodes\":%ld,\"wait_ms\":%.1f,\"search_ms\":%.1f",
+        d->card_id, d->slot_id, timed_out ? "true" : "false", stats.nodes,
+        start - job->received, searched
+    );
+    free(d);
+    return timed_out;
+}
+
+static void *worker(void *arg) {
+    const int index = (int) (intptr_t) arg;
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (!pool.head) {
+            pthread_cond_wait(&pool.job_queued, &pool.lock);
+        }
+        Job *job = pool.head;
+        pool.head = job->next;
+        if (!pool.head) {
+            pool.tail = NULL;
+        }
+        --pool.queued;
+        pool.running[index] = job;
+        ++pool.num_running;
+        pthread_mutex_unlock(&pool.lock);
+
+        const bool timed_out = runJob(job);
+        const double now = nowMs();
+
+        pthread_mutex_lock(&pool.lock);
+        pool.running[index] = NULL;
+        --pool.num_running;
+        ++pool.done;
+        pool.timed_out += timed_out;
+        pool.total_wait_ms += job->started - job->received;
+        pool.total_search_ms += now - job->started;
+        if (!pool.queued && !pool.num_running) {
+            pthread_cond_broadcast(&pool.idle);
+        }
+        pthread_mutex_unlock(&pool.lock);
+        releaseGame(job->game);
+        connectionRelease(job->conn);
+        free(job);
+    }
+    return NULL;
+}
+
+static void *watchdog(void *arg) {
+    /* Abort the running searches that are past their deadline. */
+    const struct timespec tick = {0, WATCHDOG_TICK_MS * 1000000L};
+    for (;;) {
+        nanosleep(&tick, NULL);
+        const double now = nowMs();
+        pthread_mutex_lock(&pool.lock);
+        for (int i = 0; i < pool.num_workers; ++i) {
+            Job *job = pool.running[i];
+            if (job && job->deadline && now >= job->deadline) {
+                job->abort = 1;
+            }
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+static void poolStart(int num_workers) {
+    pool.num_workers = num_workers;
+    pool.running = (Job **) calloc(num_workers, sizeof(Job *));
+    pthread_t thread;
+    for (int i = 0; i < num_workers; ++i) {
+        pthread_create(&thread, NULL, worker, (void *) (intptr_t) i);
+        pthread_detach(thread);
+    }
+    pthread_create(&thread, NULL, watchdog, NULL);
+    pthread_detach(thread);
+}
+
+/* Operations */
+
+static void opNew(Connection *conn, const char *id, const Request *req) {
+    const char *name = stringField(req, "game");
+    const char *board_name = stringField(req, "board");
+    if (!name || !board_name) {
+        replyError(conn, id, "missing game or board");
+        return;
+    }
+    int preset = 0;
+    while (
+        preset < NUM_PRESET_BOARDS
+        && strcmp(preset_boards[preset].name, board_name)
+    ) {
+        ++preset;
+    }
+    if (preset == NUM_PRESET_BOARDS) {
+        replyError(conn, id, "unknown board");
+        return;
+    }
+    Game *game = (Game *) malloc(sizeof(Game));
+    game->name = strdup(name);
+    game->board = GameBoard_NewSharing(layouts[preset]);
+    pthread_rwlock_init(&game->lock, NULL);
+    game->refs = 1;
+    pthread_mutex_lock(&games_lock);
+    const bool exists = HashMap_Has(games, game->name);
+    if (!exists) {
+        HashMap_Insert(games, game->name, game);
+    }
+    pthread_mutex_unlock(&games_lock);
+    if (exists) {
+        releaseGame(game);
+        replyError(conn, id, "the game already exists");
+        return;
+    }
+    reply(conn, id, "\"ok\":true,\"num_slots\":%d", game->board->num_slots);
+}
+
+static void opPut(
+    Connection *conn, const char *id, const Request *req, Game *game
+) {
+    int slot = -1, phase = -1;
+    const char *player_name = stringField(req, "player");
+    intField(req, "slot", &slot);
+    intField(req, "phase", &phase);
+    const Player player = !player_name ? P_NULL
+        : !strcmp(player_name, "white") ? P_WHITE
+        : !strcmp(player_name, "black") ? P_BLACK
+        : P_NULL;
+    GameBoard *board = game->board;
+    if (
+        slot < 0 || slot >= board->num_slots
+        || phase < 0 || phase >= MoonPhase_NumPhases || player == P_NULL
+    ) {
+        replyError(conn, id, "bad slot, phase or player");
+        return;
+    }
+    pthread_rwlock_wrlock(&game->lock);
+    if (board->slots[slot].phase != MP_NULL) {
+        pthread_rwlock_unlock(&game->lock);
+        replyError(conn, id, "the slot is taken");
+        return;
+    }
+    PatternNode *patterns = GameBoard_PutCard(
+        board, slot, (MoonPhase) phase, player
+    );
+    int num_patterns = 0;
+    for (const PatternNode *node = patterns; node; node = node->next) {
+        ++num_patterns;
+    }
+    PatternNode_DeleteChain(patterns);
+    const int white = board->white_stars + board->claimed[P_WHITE];
+    const int black = board->black_stars + board->claimed[P_BLACK];
+    pthread_rwlock_unlock(&game->lock);
+    reply(
+        conn, id, "\"ok\":true,\"patterns\":%d,\"white\":%d,\"black\":%d",
+        num_patterns, white, black
+    );
+}
+
+static bool opAI(
+    Connection *conn, const char *id, const Request *req, Game *game,
+    double received
+) {
+    /* Return whether a search was queued, which then owns `game`. */
+    const Field *hand = findField(req, "hand");
+    int depth = 4, deadline_ms = 0, samples = 0;
+    intField(req, "depth", &depth);
+    intField(req, "deadline_ms", &deadline_ms);
+    intField(req, "samples", &samples);
+    if (
+        !hand || hand->kind != VK_ARRAY || hand->array_len == 0
+        || hand->array_len > MAX_HAND
+        || depth < 1 || depth > MAX_DEPTH || deadline_ms < 0
+    ) {
+        replyError(conn, id, "bad hand, depth or deadline");
+        return false;
+    }
+    Job *job = (Job *) malloc(sizeof(Job));
+    for (int i = 0; i < hand->array_len; ++i) {
+        const int phase = (int) hand->array[i];
+        if (phase < 0 || phase >= MoonPhase_NumPhases) {
+            free(job);
+            replyError(conn, id, "bad phase in hand");
+            return false;
+        }
+        job->hand[i] = (MoonPhase) phase;
+    }
+    job->hand_len = hand->array_len;
+    job->conn = conn;
+    strcpy(job->id, id);
+    job->game = game;
+    job->depth = depth;
+    AIOptions_Init(&job->options);
+    job->options.abort_flag = &job->abort;
+    job->options.chance_samples = samples;
+    job->abort = 0;
+    job->received = received;
+    job->deadline = deadline_ms ? received + deadline_ms : 0;
+    connectionRetain(conn);
+    poolSubmit(job);
+    return true;
+}
+
+static void opDelete(Connection *conn, const char *id, const char *name) {
+    pthread_mutex_lock(&games_lock);
+    Game *game = (Game *) HashMap_Remove(games, (void *) name);
+    pthread_mutex_unlock(&games_lock);
+    if (!game) {
+        replyError(conn, id, "no such game");
+        return;
+    }
+    // Searches that are still queued or running keep it alive
+    releaseGame(game);
+    reply(conn, id, "\"ok\":true");
+}
+
+static void opStats(Connection *conn, const char *id) {
+    pthread_mutex_lock(&games_lock);
+    const int num_games = games->size;
+    pthread_mutex_unlock(&games_lock);
+    pthread_mutex_lock(&pool.lock);
+    const long done = pool.done ? pool.done : 1;
+    reply(
+        conn, id,
+        "\"ok\":true,\"games\":%d,\"workers\":%d,\"queued\":%d,"
+        "\"max_queued\":%d,\"running\":%d,\"done\":%ld,\"timed_out\":%ld,"
+        "\"avg_wait_ms\":%.2f,\"avg_search_ms\":%.2f",
+        num_games, pool.num_workers, pool.queued, pool.max_queued,
+        pool.num_running, pool.done, pool.timed_out,
+        pool.total_wait_ms / done, pool.total_search_ms / done
+    );
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void handleLine(Connection *conn, const char *line) {
+    const double received = nowMs();
+    Request req;
+    const char *error = parseRequest(line, &req);
+    char id[MAX_ID_LEN + 1] = "";
+    const Field *id_field = error ? NULL : findField(&req, "id");
+    if (id_field && id_field->kind != VK_ARRAY) {
+        if (id_field->raw_len > MAX_ID_LEN) {
+            error = "id too long";
+        }
+        else {
+            memcpy(id, id_field->raw, id_field->raw_len);
+            id[id_field->raw_len] = '\0';
+        }
+    }
+    if (error) {
+        replyError(conn, id, error);
+        return;
+    }
+    const char *op = stringField(&req, "op");
+    if (!op) {
+        replyError(conn, id, "missing op");
+        return;
+    }
+    if (!strcmp(op, "new")) {
+        opNew(conn, id, &req);
+        return;
+    }
+    if (!strcmp(op, "stats")) {
+        opStats(conn, id);
+        return;
+    }
+    const char *name = stringField(&req, "game");
+    if (!name) {
+        replyError(conn, id, "missing game");
+        return;
+    }
+    if (!strcmp(op, "delete")) {
+        opDelete(conn, id, name);
+        return;
+    }
+    Game *game = acquireGame(name);
+    if (!game) {
+        replyError(conn, id, "no such game");
+        return;
+    }
+    if (!strcmp(op, "put")) {
+        opPut(conn, id, &req, game);
+    }
+    else if (!strcmp(op, "ai")) {
+        if (opAI(conn, id, &req, game, received)) {
+            return;
+        }
+    }
+    else {
+        replyError(conn, id, "unknown op");
+    }
+    releaseGame(game);
+}
+
+static void serve(Connection *conn) {
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len;
+    while ((len = getline(&line, &capacity, conn->in)) > 0) {
+        if (len > 1 || line[0] != '\n') {
+            handleLine(conn, line);
+        }
+    }
+    free(line);
+}
+
+static void *serveClient(void *arg) {
+    Connection *conn = (Connection *) arg;
+    serve(conn);
+    connectionRelease(conn);
+    return NULL;
+}
+
+static int listenOn(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return 1;
+    }
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (
+        fd < 0
+        || bind(fd, (struct sockaddr *) &addr, sizeof(addr))
+        || listen(fd, 16)
+    ) {
+        perror(path);
+        return 1;
+    }
+    for (;;) {
+        const int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return 1;
+        }
+        pthread_t thread;
+        Connection *conn = Connection_New(fdopen(client, "r"), client);
+        pthread_create(&thread, NULL, serveClient, conn);
+        pthread_detach(thread);
+    }
+}
+
+int main(int argc, char **argv) {
+    int num_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    const char *socket_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "--workers")) {
+            num_workers = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && !strcmp(argv[i], "--socket")) {
+            socket_path = argv[++i];
+        }
+        else {
+            fprintf(
+                stderr, "usage: %s [--workers N] [--socket PATH]\n", argv[0]
+            );
+            return 2;
+        }
+    }
+    if (num_workers < 1) {
+        num_workers = 1;
+    }
+    // Replies to clients that hung up fail instead of killing us
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < NUM_PRESET_BOARDS; ++i) {
+        layouts[i] = GameBoard_FromEdges(
+            *preset_boards[i].num_slots, preset_boards[i].edges
+        );
+    }
+    games = HashMap_New(hashName, nameEqual, NULL);
+    poolStart(num_workers);
+    if (socket_path) {
+        return listenOn(socket_path);
+    }
+    // Answer stdin until it ends, then wait for the searches in flight
+    serve(Connection_New(stdin, STDOUT_FILENO));
+    poolWaitIdle();
+    return 0;
+}
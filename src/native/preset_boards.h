@@ -0,0 +1,34 @@
+#ifndef LUNAR_PRESET_BOARDS_H
+#define LUNAR_PRESET_BOARDS_H
+
+// The preset boards of boards_data.inc, for the native tools
+
+#include "../backend/lunar_game.h"
+
+typedef struct PresetBoard {
+    const char *name;
+    const int *num_slots;
+    const int *edges;
+} PresetBoard;
+
+#define BOARD_BEGIN(name, num) \
+    {#name, &PresetBoard_N_ ## name, PresetBoard_Data_ ## name},
+#define EDGE(x, y)
+#define BOARD_END
+#define DISPLAY_BEGIN(name, x_len, y_len)
+#define POS(x, y)
+#define DISPLAY_END
+static const PresetBoard preset_boards[] = {
+#include "../backend/boards_data.inc"
+};
+#undef BOARD_BEGIN
+#undef EDGE
+#undef BOARD_END
+#undef DISPLAY_BEGIN
+#undef POS
+#undef DISPLAY_END
+
+#define NUM_PRESET_BOARDS \
+    ((int) (sizeof(preset_boards) / sizeof(preset_boards[0])))
+
+#endif  /* LUNAR_PRESET_BOARDS_H */